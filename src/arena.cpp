@@ -0,0 +1,66 @@
+#include "arena.hpp"
+#include "memory.hpp"
+
+// Define NULL if not defined
+#ifndef NULL
+#define NULL 0
+#endif
+
+// Alignment of every arena allocation
+#define ARENA_ALIGN 8
+
+// Space for the descriptor, rounded so the buffer starts on a cache line
+#define ARENA_HEADER_SIZE ((sizeof(Arena) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1))
+
+// Create an arena with one heap allocation holding both descriptor and buffer
+Arena* arena_create(unsigned int size) {
+    Arena* arena = (Arena*)memory_alloc_aligned(ARENA_HEADER_SIZE + size, CACHE_LINE_SIZE);
+    if (arena == NULL) {
+        return NULL;
+    }
+    
+    arena->base = reinterpret_cast<unsigned char*>(arena) + ARENA_HEADER_SIZE;
+    arena->size = size;
+    arena->used = 0;
+    arena->peak = 0;
+    
+    return arena;
+}
+
+// Return the arena and everything allocated from it to the heap
+void arena_destroy(Arena* arena) {
+    memory_free(arena);
+}
+
+// Bump-allocate from the arena
+void* arena_alloc(Arena* arena, unsigned int size) {
+    unsigned int offset = (arena->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (size > arena->size || offset > arena->size - size) {
+        // Arena exhausted
+        return NULL;
+    }
+    
+    arena->used = offset + size;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    
+    return arena->base + offset;
+}
+
+// Remember the current position so a scope can release what it allocated
+unsigned int arena_mark(Arena* arena) {
+    return arena->used;
+}
+
+// Release everything allocated since a mark
+void arena_release(Arena* arena, unsigned int mark) {
+    if (mark < arena->used) {
+        arena->used = mark;
+    }
+}
+
+// Release everything in the arena
+void arena_reset(Arena* arena) {
+    arena->used = 0;
+}
@@ -0,0 +1,21 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+// Arena (bump) allocator for short-lived kernel work.
+// Objects carry no header and are released together by arena_reset or arena_release.
+struct Arena {
+    unsigned char* base;
+    unsigned int size;
+    unsigned int used;
+    unsigned int peak;   // High-water mark, useful for sizing the arena
+};
+
+// Arena functions
+Arena* arena_create(unsigned int size);
+void arena_destroy(Arena* arena);
+void* arena_alloc(Arena* arena, unsigned int size);
+unsigned int arena_mark(Arena* arena);
+void arena_release(Arena* arena, unsigned int mark);
+void arena_reset(Arena* arena);
+
+#endif // ARENA_HPP
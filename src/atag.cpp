@@ -0,0 +1,81 @@
+#include "atag.hpp"
+
+/*
+ * ATAG parsing for QEMU/VersatilePB
+ * QEMU places the tag list at the conventional address 0x100 and passes
+ * it in r2; the list always starts with ATAG_CORE and ends with ATAG_NONE.
+ */
+
+// Define NULL if not defined
+#ifndef NULL
+#define NULL 0
+#endif
+
+// Physical address of the tag list
+#define ATAG_BASE 0x100
+
+// Upper bound on tags to walk, in case the list is garbage
+#define ATAG_MAX_TAGS 32
+
+// Find the first tag of a type (NULL if missing or there is no tag list)
+const AtagHeader* atag_find(unsigned int tag) {
+    // Pass the address through an empty asm so GCC cannot see it is a
+    // constant; at -O2 it treats loads from low constants as out of bounds
+    unsigned long base = ATAG_BASE;
+    asm("" : "+r"(base));
+    const AtagHeader* header = reinterpret_cast<const AtagHeader*>(base);
+    if (header->tag != ATAG_CORE) {
+        return NULL;
+    }
+    
+    for (int i = 0; i < ATAG_MAX_TAGS && header->tag != ATAG_NONE; i++) {
+        if (header->tag == tag) {
+            return header;
+        }
+        if (header->size == 0) {
+            break;
+        }
+        header = reinterpret_cast<const AtagHeader*>(
+            reinterpret_cast<const unsigned int*>(header) + header->size);
+    }
+    return NULL;
+}
+
+// Get the first RAM bank described by the boot loader
+bool atag_mem(unsigned int* start, unsigned int* size) {
+    const AtagHeader* header = atag_find(ATAG_MEM);
+    if (header == NULL) {
+        return false;
+    }
+    
+    const AtagMem* mem = reinterpret_cast<const AtagMem*>(header + 1);
+    *start = mem->start;
+    *size = mem->size;
+    return true;
+}
+
+// Check the kernel command line (QEMU's -append) for a space-separated option
+bool atag_cmdline_has(const char* option) {
+    const AtagHeader* header = atag_find(ATAG_CMDLINE);
+    if (header == NULL) {
+        return false;
+    }
+    
+    const char* cmdline = reinterpret_cast<const char*>(header + 1);
+    const char* end = cmdline + (header->size - 2) * 4;
+    const char* word = cmdline;
+    while (word < end && *word) {
+        int i = 0;
+        while (option[i] && word + i < end && word[i] == option[i]) {
+            i++;
+        }
+        if (option[i] == '\0' && (word + i == end || word[i] == ' ' || word[i] == '\0')) {
+            return true;
+        }
+        
+        // Skip to the next word
+        while (word < end && *word && *word != ' ') word++;
+        while (word < end && *word == ' ') word++;
+    }
+    return false;
+}
@@ -0,0 +1,30 @@
+#ifndef ATAG_HPP
+#define ATAG_HPP
+
+// Boot information passed by the boot loader (or QEMU's -kernel loader)
+// as a list of ARM tags
+
+// Tag identifiers
+#define ATAG_NONE    0x00000000
+#define ATAG_CORE    0x54410001
+#define ATAG_MEM     0x54410002
+#define ATAG_CMDLINE 0x54410009
+
+// Tag header (size is in 32-bit words, including the header)
+struct AtagHeader {
+    unsigned int size;
+    unsigned int tag;
+};
+
+// ATAG_MEM payload
+struct AtagMem {
+    unsigned int size;
+    unsigned int start;
+};
+
+// ATAG functions
+const AtagHeader* atag_find(unsigned int tag);
+bool atag_mem(unsigned int* start, unsigned int* size);
+bool atag_cmdline_has(const char* option);
+
+#endif // ATAG_HPP
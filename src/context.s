@@ -0,0 +1,23 @@
+/*
+ * Context switch
+ * Only the registers a called function must preserve are saved; the
+ * caller-saved ones are already on the stack or dead at the call.
+ */
+
+.syntax unified
+.arm
+.text
+
+@ void context_switch(CpuContext* from, CpuContext* to)
+@ CpuContext is {r4-r11, sp, lr, cpsr}; see process.hpp
+.global context_switch
+.type context_switch, %function
+context_switch:
+    stmia   r0, {r4-r11, sp, lr}
+    mrs     r2, cpsr
+    str     r2, [r0, #40]
+    ldr     r2, [r1, #40]
+    msr     cpsr_cxsf, r2
+    ldmia   r1, {r4-r11, sp, lr}
+    bx      lr
+.size context_switch, . - context_switch
@@ -0,0 +1,81 @@
+#ifndef DMA_HPP
+#define DMA_HPP
+
+// Number of PL080 channels
+#define DMA_CHANNELS 8
+
+// Linked-list items available to each channel
+#define DMA_MAX_LLI 8
+
+// Largest transfer one linked-list item can describe (in transfer units)
+#define DMA_MAX_TRANSFER 4095
+
+// Copies smaller than this are done by the CPU
+#define DMA_MEMCPY_THRESHOLD 1024
+
+// UART writes smaller than this are done by the CPU
+#define DMA_UART_THRESHOLD 256
+
+// Linked-list item, read by the controller (must be word aligned)
+struct DmaLLI {
+    unsigned int src;
+    unsigned int dst;
+    unsigned int next;       // Next item, 0 at the end of the list
+    unsigned int control;    // Channel control word for this item
+};
+
+// Transfer widths for the descriptor API
+enum DmaWidth {
+    DMA_WIDTH_BYTE = 0,
+    DMA_WIDTH_HALF = 1,
+    DMA_WIDTH_WORD = 2
+};
+
+// Descriptor flags
+#define DMA_SRC_INCREMENT (1 << 0)
+#define DMA_DST_INCREMENT (1 << 1)
+
+// Called once a transfer has finished (ok is false after a bus error)
+typedef void (*DmaCallback)(int channel, bool ok, void* arg);
+
+// Controller and channel allocation
+void dma_init();
+bool dma_available();
+int dma_channel_alloc();
+void dma_channel_free(int channel);
+
+// Linked-list descriptors. Items belong to the channel and are rebuilt per transfer.
+DmaLLI* dma_lli(int channel, unsigned int index);
+void dma_lli_set(DmaLLI* item, const void* src, void* dst, unsigned int count,
+                 DmaWidth width, unsigned int flags);
+void dma_lli_chain(DmaLLI* item, DmaLLI* next);
+bool dma_start(int channel, int peripheral, DmaCallback callback, void* arg);
+
+// Completion. dma_poll runs the callbacks of finished channels.
+void dma_poll();
+bool dma_busy(int channel);
+bool dma_wait(int channel);
+
+// Memory copies
+int dma_memcpy_async(void* dest, const void* src, unsigned int n, DmaCallback callback, void* arg);
+void* dma_memcpy(void* dest, const void* src, unsigned int n);
+
+// UART0 output
+void dma_uart_write(const char* buf, unsigned int len);
+
+// DMA statistics
+struct DmaStats {
+    unsigned int transfers;        // Completed transfers
+    unsigned int bytes;            // Bytes moved by the controller
+    unsigned int errors;
+    unsigned int channels_busy;
+    unsigned int cpu_copies;       // dma_memcpy calls done by the CPU instead
+    unsigned int uart_bytes;       // UART bytes sent by DMA
+    bool uart_dma;                 // UART TX requests work on this machine
+};
+
+DmaStats dma_get_stats();
+
+void dma_benchmark();
+
+#endif // DMA_HPP
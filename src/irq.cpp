@@ -0,0 +1,139 @@
+#include "irq.hpp"
+#include "mmu.hpp"
+#include "process.hpp"
+#include "uart.hpp"
+
+/*
+ * PL190 Vectored Interrupt Controller for QEMU/VersatilePB
+ * Based on PrimeCell Vectored Interrupt Controller (PL190) Technical Reference Manual
+ * All sources are routed to IRQ and dispatched in software. The assembly
+ * entry in vector.s saves the interrupted context on its own stack, so a
+ * handler may ask for a reschedule and switch to another process on exit.
+ */
+
+// Forward declarations
+void int_to_str(unsigned int num, char* str);
+extern "C" void vectors_install();
+
+// Define NULL if not defined
+#ifndef NULL
+#define NULL 0
+#endif
+
+// Base physical address of the VIC
+#define VIC_BASE            0x10140000
+
+// Register offsets from base address
+#define VIC_IRQ_STATUS      0x000  // Masked IRQ status
+#define VIC_INT_SELECT      0x00C  // IRQ/FIQ select (0 = IRQ)
+#define VIC_INT_ENABLE      0x010  // Enable set
+#define VIC_INT_EN_CLEAR    0x014  // Enable clear
+#define VIC_SOFT_INT_CLEAR  0x01C  // Software interrupt clear
+
+// Helper macro for register access
+#define VIC_REG(offset) (*(volatile unsigned int*)(VIC_BASE + (offset)))
+
+// Handlers per interrupt line
+static void (*handlers[IRQ_LINES])() = { NULL };
+// Set by handlers that want a different process to run
+static bool schedule_pending = false;
+// Interrupts taken since boot
+static unsigned int interrupts = 0;
+// Set while the handlers run (not during the switch that may follow)
+static bool in_handler = false;
+
+// Install the exception vectors and quiet the interrupt controller
+void irq_init() {
+    VIC_REG(VIC_INT_EN_CLEAR) = 0xFFFFFFFF;
+    VIC_REG(VIC_SOFT_INT_CLEAR) = 0xFFFFFFFF;
+    VIC_REG(VIC_INT_SELECT) = 0;
+    
+    // The table is copied to address 0 through the data cache
+    vectors_install();
+    dcache_clean_all();
+    icache_invalidate_all();
+}
+
+// Route an interrupt line to a handler and unmask it
+void irq_register(unsigned int irq, void (*handler)()) {
+    if (irq >= IRQ_LINES) return;
+    
+    handlers[irq] = handler;
+    VIC_REG(VIC_INT_ENABLE) = 1u << irq;
+}
+
+// Mask an interrupt line and drop its handler
+void irq_unregister(unsigned int irq) {
+    if (irq >= IRQ_LINES) return;
+    
+    VIC_REG(VIC_INT_EN_CLEAR) = 1u << irq;
+    handlers[irq] = NULL;
+}
+
+// Ask for process_schedule to run when the current interrupt returns
+void irq_request_schedule() {
+    schedule_pending = true;
+}
+
+// Number of interrupts handled since boot
+unsigned int irq_count() {
+    return interrupts;
+}
+
+// Whether the caller is an interrupt handler, which must leave switching
+// processes to irq_request_schedule
+bool irq_in_handler() {
+    return in_handler;
+}
+
+// Called from irq_entry in SVC mode with IRQs disabled
+extern "C" void irq_handle() {
+    unsigned int status = VIC_REG(VIC_IRQ_STATUS);
+    interrupts++;
+    
+    in_handler = true;
+    while (status) {
+        unsigned int irq = __builtin_ctz(status);
+        status &= status - 1;
+        
+        if (handlers[irq]) {
+            handlers[irq]();
+        } else {
+            // Nobody wants it; keep it from firing again
+            VIC_REG(VIC_INT_EN_CLEAR) = 1u << irq;
+        }
+    }
+    in_handler = false;
+    
+    // Switch only after every handler has run
+    if (schedule_pending) {
+        schedule_pending = false;
+        process_schedule();
+    }
+}
+
+// Called from the undefined-instruction and abort vectors. Does not return.
+extern "C" void exception_fault(unsigned int type, unsigned int address) {
+    static const char* names[] = { "Reset", "Undefined instruction", "SWI", "Prefetch abort", "Data abort" };
+    char buf[16];
+    
+    uart_puts("\n*** ");
+    uart_puts(type < 5 ? names[type] : "Exception");
+    uart_puts(" at 0x");
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        unsigned int digit = (address >> shift) & 0xF;
+        uart_putc(digit < 10 ? '0' + digit : 'A' + digit - 10);
+    }
+    Process* current = process_get_current();
+    if (current != NULL) {
+        uart_puts(" in process ");
+        int_to_str(current->id, buf);
+        uart_puts(buf);
+        uart_puts(" (");
+        uart_puts(current->name);
+        uart_puts(")");
+    }
+    uart_puts(" ***\nSystem halted.\n");
+    
+    while (1);
+}
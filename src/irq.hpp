@@ -0,0 +1,54 @@
+#ifndef IRQ_HPP
+#define IRQ_HPP
+
+// VIC interrupt lines on VersatilePB
+#define IRQ_TIMER01 4     // SP804 timers 0 and 1
+#define IRQ_UART0   12
+#define IRQ_DMA     17
+#define IRQ_LINES   32
+
+// CPSR bits
+#define CPSR_MODE_SVC 0x13
+#define CPSR_I_BIT    0x80
+
+// Interrupt controller and exception vectors
+void irq_init();
+void irq_register(unsigned int irq, void (*handler)());
+void irq_unregister(unsigned int irq);
+void irq_request_schedule();
+unsigned int irq_count();
+bool irq_in_handler();
+
+// Disable IRQs and return the previous CPSR
+static inline unsigned int irq_save() {
+    unsigned int flags;
+    unsigned int masked;
+    asm volatile("mrs %0, cpsr\n\t"
+                 "orr %1, %0, #0x80\n\t"
+                 "msr cpsr_c, %1"
+                 : "=r"(flags), "=r"(masked) : : "memory");
+    return flags;
+}
+
+// Restore the IRQ mask saved by irq_save
+static inline void irq_restore(unsigned int flags) {
+    asm volatile("msr cpsr_c, %0" : : "r"(flags) : "memory");
+}
+
+// Unmask IRQs
+static inline void irq_enable() {
+    unsigned int cpsr;
+    asm volatile("mrs %0, cpsr\n\t"
+                 "bic %0, %0, #0x80\n\t"
+                 "msr cpsr_c, %0"
+                 : "=r"(cpsr) : : "memory");
+}
+
+// Keeps IRQs disabled for the rest of the enclosing scope
+struct IrqGuard {
+    unsigned int flags;
+    IrqGuard() : flags(irq_save()) {}
+    ~IrqGuard() { irq_restore(flags); }
+};
+
+#endif // IRQ_HPP
@@ -2,14 +2,19 @@
 #include "memory.hpp"
 #include "process.hpp"
 #include "monitor.hpp"
+#include "slab.hpp"
+#include "arena.hpp"
+#include "mmu.hpp"
+#include "kstring.hpp"
+#include "dma.hpp"
+#include "irq.hpp"
+#include "atag.hpp"
+#include "timer.hpp"
+#include "ktimer.hpp"
+#include "sync.hpp"
 
-// Forward declarations for standard functions
-int strcmp(const char* s1, const char* s2);
-void* memset(void* s, int c, unsigned int n);
-char* strcpy(char* dest, const char* src);
-char* strcat(char* dest, const char* src);
-int strlen(const char* str);
-char* strtok(char* str, const char* delim);
+// Forward declarations
+void int_to_str(unsigned int num, char* str);
 
 // Maximum number of files/directories per directory
 #define MAX_FILES 16
@@ -17,50 +22,21 @@ char* strtok(char* str, const char* delim);
 #define MAX_PATH 128
 // Maximum filename length
 #define MAX_NAME 32
-// Maximum file content size
-#define MAX_FILE_SIZE 1024
+// Initial content buffer of a new file (doubled by file_reserve as it grows)
+#define FILE_INITIAL_SIZE 32
 // Maximum line length for editor
 #define MAX_LINE_LENGTH 80
+// Maximum number of lines in the editor
+#define MAX_LINES 100
+// Maximum shell command length
+#define MAX_CMD_LENGTH 64
+// Scratch arena for the shell, reset before every command (16 KB)
+#define SHELL_ARENA_SIZE (16 * 1024)
 // NULL definition if not already defined
 #ifndef NULL
 #define NULL 0
 #endif
 
-// Simple memory allocation system using our new memory management
-static bool use_old_malloc = true;  // Flag to use old or new memory system
-
-// Original heap (will be deprecated)
-#define OLD_HEAP_SIZE 32768  // 32 KB heap
-static unsigned char old_heap[OLD_HEAP_SIZE];
-static unsigned int old_heap_pos = 0;
-
-// Original allocation function (deprecated)
-void* old_kmalloc(unsigned int size) {
-    if (old_heap_pos + size > OLD_HEAP_SIZE) {
-        // Out of memory
-        return NULL;
-    }
-    
-    void* ptr = &old_heap[old_heap_pos];
-    old_heap_pos += size;
-    
-    // Zero-initialize memory
-    for (unsigned int i = 0; i < size; i++) {
-        ((unsigned char*)ptr)[i] = 0;
-    }
-    
-    return ptr;
-}
-
-// Allocate memory (wrapper function)
-void* kmalloc(unsigned int size) {
-    if (use_old_malloc) {
-        return old_kmalloc(size);
-    } else {
-        return memory_alloc(size);
-    }
-}
-
 // File system node type
 enum NodeType {
     TYPE_FILE,
@@ -77,8 +53,8 @@ struct FSNode {
     struct FSNode* children[MAX_FILES];
     int child_count;
     
-    // For files only
-    char* content;
+    // For files only (content is movable so the heap can be compacted)
+    MemHandle content;
     unsigned int content_size;
     unsigned int content_capacity;
 };
@@ -87,15 +63,27 @@ struct FSNode {
 FSNode* root_dir = NULL;
 FSNode* current_dir = NULL;
 
+// Object cache for file system nodes
+static KmemCache* fsnode_cache = NULL;
+
 // Buffer for storing current path
 char current_path[MAX_PATH];
 
+// Scratch memory for command parsing, the editor and other transient work
+static Arena* shell_arena = NULL;
+
 // Function to create a new node
 FSNode* create_node(const char* name, NodeType type, FSNode* parent) {
-    FSNode* node = (FSNode*)kmalloc(sizeof(FSNode));
+    FSNode* node = (FSNode*)kmem_cache_alloc(fsnode_cache);
+    if (node == NULL) {
+        return NULL;
+    }
+    
+    // Slab objects are recycled, so start from a clean node
+    memset(node, 0, sizeof(FSNode));
     
     // Initialize node
-    for (int i = 0; i < MAX_NAME && name[i]; i++) {
+    for (int i = 0; i < MAX_NAME - 1 && name[i]; i++) {
         node->name[i] = name[i];
     }
     node->type = type;
@@ -108,21 +96,56 @@ FSNode* create_node(const char* name, NodeType type, FSNode* parent) {
         for (int i = 0; i < MAX_FILES; i++) {
             node->children[i] = NULL;
         }
-        node->content = NULL;
+        node->content = 0;
         node->content_size = 0;
         node->content_capacity = 0;
     } else {
         // Allocate initial content buffer for files
-        node->content = (char*)kmalloc(MAX_FILE_SIZE);
+        node->content = memory_handle_alloc(FILE_INITIAL_SIZE);
+        if (node->content == 0) {
+            kmem_cache_free(fsnode_cache, node);
+            return NULL;
+        }
         node->content_size = 0;
-        node->content_capacity = MAX_FILE_SIZE;
+        node->content_capacity = memory_handle_size(node->content);
     }
     
     return node;
 }
 
+// Get the address of a file's content and keep it there until file_unpin.
+// Without the pin, another process's allocation could compact the heap and
+// move it while the caller is preempted.
+char* file_pin(FSNode* file) {
+    return (char*)memory_handle_pin(file->content);
+}
+
+void file_unpin(FSNode* file) {
+    memory_handle_unpin(file->content);
+}
+
+// Make room for size bytes of file content, doubling the buffer as needed
+bool file_reserve(FSNode* file, unsigned int size) {
+    if (size <= file->content_capacity) {
+        return true;
+    }
+    
+    unsigned int capacity = file->content_capacity;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    if (!memory_handle_realloc(file->content, capacity)) {
+        return false;
+    }
+    file->content_capacity = memory_handle_size(file->content);
+    return true;
+}
+
 // Initialize the file system
 void fs_init() {
+    // Create the node cache
+    fsnode_cache = kmem_cache_create("fsnode", sizeof(FSNode), 4);
+    
     // Create root directory
     root_dir = create_node("/", TYPE_DIRECTORY, NULL);
     current_dir = root_dir;
@@ -141,11 +164,15 @@ void fs_init() {
     const char* readme_content = "Welcome to JasOS!\n\nThis is a simple operating system with a text-based interface.\n"
                           "Use the 'help' command to see available commands.\n"
                           "Type 'monitor' to start the system monitor.\n";
-    int len = 0;
-    while (readme_content[len]) {
-        readme->content[len] = readme_content[len];
-        len++;
+    int len = strlen(readme_content);
+    if (!file_reserve(readme, len)) {
+        return;
     }
+    char* data = file_pin(readme);
+    for (int i = 0; i < len; i++) {
+        data[i] = readme_content[i];
+    }
+    file_unpin(readme);
     readme->content_size = len;
 }
 
@@ -250,6 +277,10 @@ void cmd_mkdir(const char* name) {
     
     // Create new directory
     FSNode* new_dir = create_node(name, TYPE_DIRECTORY, current_dir);
+    if (new_dir == NULL) {
+        uart_puts("Out of memory\n");
+        return;
+    }
     current_dir->children[current_dir->child_count++] = new_dir;
     
     uart_puts("Directory created: ");
@@ -277,6 +308,10 @@ void cmd_touch(const char* name) {
     
     // Create new file
     FSNode* new_file = create_node(name, TYPE_FILE, current_dir);
+    if (new_file == NULL) {
+        uart_puts("Out of memory\n");
+        return;
+    }
     current_dir->children[current_dir->child_count++] = new_file;
     
     uart_puts("File created: ");
@@ -301,7 +336,8 @@ void cmd_cat(const char* name) {
             if (node->content_size == 0) {
                 uart_puts("(Empty file)\n");
             } else {
-                uart_puts(node->content);
+                dma_uart_write(file_pin(node), node->content_size);
+                file_unpin(node);
                 uart_puts("\n");
             }
             return;
@@ -430,28 +466,33 @@ void display_lines(const char* name, char lines[][MAX_LINE_LENGTH], int line_cou
 }
 
 void save_file(FSNode* file, char lines[][MAX_LINE_LENGTH], int line_count) {
+    // Work out the saved size so the buffer only grows once
+    unsigned int size = 0;
+    for (int i = 0; i < line_count; i++) {
+        size += strlen(lines[i]) + 1;
+    }
+    
+    if (!file_reserve(file, size)) {
+        uart_puts("\nNot enough memory to save file!\n");
+        return;
+    }
+    
     // Clear file content
     file->content_size = 0;
+    char* data = file_pin(file);
     
     // Save all lines
     for (int i = 0; i < line_count; i++) {
         int len = strlen(lines[i]);
         
-        // Check if we have enough space
-        if (file->content_size + len + 1 <= file->content_capacity) {
-            // Copy line content
-            for (int j = 0; j < len; j++) {
-                file->content[file->content_size++] = lines[i][j];
-            }
-            
-            // Add newline
-            file->content[file->content_size++] = '\n';
-        } else {
-            // Not enough space
-            uart_puts("\nFile too large to save completely!\n");
-            return;
-        }
+        // Copy line content (lines are far below the DMA threshold)
+        memcpy(data + file->content_size, lines[i], len);
+        file->content_size += len;
+        
+        // Add newline
+        data[file->content_size++] = '\n';
     }
+    file_unpin(file);
     
     // Show save message
     uart_puts("\nFile saved.\n");
@@ -485,6 +526,10 @@ void cmd_edit(const char* name) {
         }
         
         file = create_node(name, TYPE_FILE, current_dir);
+        if (file == NULL) {
+            uart_puts("Out of memory\n");
+            return;
+        }
         current_dir->children[current_dir->child_count++] = file;
         uart_puts("New file created: ");
         uart_puts(name);
@@ -499,10 +544,14 @@ void cmd_edit(const char* name) {
     uart_puts(name);
     uart_puts("\n");
     
-    // Parse the file content into lines
-    const int MAX_LINES = 100;
+    // Parse the file content into lines (the buffer lives for this editing session only)
+    unsigned int arena_scope = arena_mark(shell_arena);
+    char (*lines)[MAX_LINE_LENGTH] = (char (*)[MAX_LINE_LENGTH])arena_alloc(shell_arena, MAX_LINES * MAX_LINE_LENGTH);
+    if (lines == NULL) {
+        uart_puts("Not enough memory to edit file\n");
+        return;
+    }
     
-    char lines[MAX_LINES][MAX_LINE_LENGTH];
     int line_count = 0;
     int cursor_x = 0;
     int cursor_y = 0;
@@ -519,8 +568,9 @@ void cmd_edit(const char* name) {
     if (file->content_size > 0) {
         int line_pos = 0;
         
+        char* data = file_pin(file);
         for (unsigned int i = 0; i < file->content_size; i++) {
-            char c = file->content[i];
+            char c = data[i];
             
             if (c == '\n') {
                 // End of line
@@ -539,6 +589,7 @@ void cmd_edit(const char* name) {
                 }
             }
         }
+        file_unpin(file);
         
         // Handle the last line if it doesn't end with a newline
         if (line_pos > 0) {
@@ -750,6 +801,9 @@ void cmd_edit(const char* name) {
         }
     }
     
+    // Release the line buffer
+    arena_release(shell_arena, arena_scope);
+    
     // Clear screen and return to shell
     uart_puts("\033[2J\033[H");
 }
@@ -790,6 +844,10 @@ void cmd_rm(const char* name) {
         current_dir->children[i] = current_dir->children[i + 1];
     }
     current_dir->child_count--;
+    if (node->type == TYPE_FILE) {
+        memory_handle_free(node->content);
+    }
+    kmem_cache_free(fsnode_cache, node);
     
     uart_puts("Removed: ");
     uart_puts(name);
@@ -1146,20 +1204,28 @@ void cmd_monitor() {
     monitor_update();
     
     // Simple command loop for the monitor
-    char cmd[64];
     int cmd_pos = 0;
-    char cmd_name[32];
-    char cmd_arg[32];
+    unsigned int arena_scope = arena_mark(shell_arena);
     
     while (1) {
+        // Command buffers only live for one iteration
+        arena_release(shell_arena, arena_scope);
+        char* cmd = (char*)arena_alloc(shell_arena, MAX_CMD_LENGTH);
+        char* cmd_name = (char*)arena_alloc(shell_arena, 32);
+        char* cmd_arg = (char*)arena_alloc(shell_arena, 32);
+        if (cmd == NULL || cmd_name == NULL || cmd_arg == NULL) {
+            uart_puts("Not enough memory for the monitor\n");
+            return;
+        }
+        
         // Get command
         uart_puts("\nmonitor> ");
         
         // Read command
         cmd_pos = 0;
-        for (int i = 0; i < 64; i++) cmd[i] = 0;
-        for (int i = 0; i < 32; i++) cmd_name[i] = 0;
-        for (int i = 0; i < 32; i++) cmd_arg[i] = 0;
+        memset(cmd, 0, MAX_CMD_LENGTH);
+        memset(cmd_name, 0, 32);
+        memset(cmd_arg, 0, 32);
         
         while (1) {
             char c = uart_getc();
@@ -1173,7 +1239,7 @@ void cmd_monitor() {
                     cmd_pos--;
                     uart_puts("\b \b"); // Erase character
                 }
-            } else if (cmd_pos < 63) {
+            } else if (cmd_pos < MAX_CMD_LENGTH - 1) {
                 uart_putc(c);
                 cmd[cmd_pos++] = c;
             }
@@ -1225,11 +1291,51 @@ void cmd_monitor() {
         // Process all other commands
         monitor_process_command(cmd_name, cmd_arg);
     }
+    
+    arena_release(shell_arena, arena_scope);
+}
+
+// Command to compact the heap and report the fragmentation change
+void cmd_compact() {
+    MemoryStats before = memory_get_stats();
+    unsigned int moved = memory_compact();
+    MemoryStats after = memory_get_stats();
+    
+    char buf[16];
+    uart_puts("Moved ");
+    int_to_str(moved, buf);
+    uart_puts(buf);
+    uart_puts(" blocks\n");
+    
+    uart_puts("Largest free block: ");
+    int_to_str(before.largest_free, buf);
+    uart_puts(buf);
+    uart_puts(" -> ");
+    int_to_str(after.largest_free, buf);
+    uart_puts(buf);
+    uart_puts(" bytes\n");
+    
+    uart_puts("Fragmentation: ");
+    int_to_str(before.fragmentation, buf);
+    uart_puts(buf);
+    uart_puts("% -> ");
+    int_to_str(after.fragmentation, buf);
+    uart_puts(buf);
+    uart_puts("%\n");
 }
 
 // Command to create a test process
-void cmd_testproc() {
-    int pid = process_create("testproc", test_process_func, 5);
+void cmd_testproc(const char* arg) {
+    // Optional priority argument
+    unsigned int priority = 5;
+    if (arg[0] >= '0' && arg[0] <= '9') {
+        priority = 0;
+        for (int i = 0; arg[i] >= '0' && arg[i] <= '9'; i++) {
+            priority = priority * 10 + (arg[i] - '0');
+        }
+    }
+    
+    int pid = process_create("testproc", test_process_func, priority);
     if (pid >= 0) {
         uart_puts("Created test process with PID ");
         char buf[16];
@@ -1255,19 +1361,111 @@ void cmd_testproc() {
     }
 }
 
-// Timer tick simulation function
-void simulate_timer_tick() {
-    static unsigned int tick_count = 0;
+// Job of an rtproc process: stays busy for three quarters of its budget
+void rt_demo_job() {
+    Process* self = process_get_current();
+    unsigned int work_us = self->rt_budget_ms * 750;
+    unsigned int start = timer_read();
+    while (timer_ticks_to_us(timer_read() - start) < work_us) {
+        // Busy work
+    }
+}
+
+// Command to create a periodic real-time process: rtproc <period_ms> <budget_ms>
+void cmd_rtproc(const char* arg) {
+    unsigned int period = 0;
+    unsigned int budget = 0;
+    int i = 0;
+    
+    while (arg[i] >= '0' && arg[i] <= '9') {
+        period = period * 10 + (arg[i++] - '0');
+    }
+    while (arg[i] == ' ') i++;
+    while (arg[i] >= '0' && arg[i] <= '9') {
+        budget = budget * 10 + (arg[i++] - '0');
+    }
+    
+    if (period == 0 || budget == 0 || budget > period) {
+        uart_puts("Usage: rtproc <period_ms> <budget_ms> (budget <= period)\n");
+        return;
+    }
+    
+    char buf[16];
+    int pid = process_create_periodic("rtproc", rt_demo_job, period, budget);
+    if (pid < 0) {
+        uart_puts("Rejected: ");
+        int_to_str(process_get_rt_utilization() / 10, buf);
+        uart_puts(buf);
+        uart_puts("% of the CPU is already reserved (limit ");
+        int_to_str(PROCESS_RT_MAX_UTILIZATION / 10, buf);
+        uart_puts(buf);
+        uart_puts("%)\n");
+        return;
+    }
+    
+    uart_puts("Created real-time process with PID ");
+    int_to_str(pid, buf);
+    uart_puts(buf);
+    uart_puts("\n");
+}
+
+// Command to set the time slice of a priority level: slice <priority> <ms>
+void cmd_slice(const char* arg) {
+    unsigned int priority = 0;
+    unsigned int ms = 0;
+    int i = 0;
+    
+    while (arg[i] >= '0' && arg[i] <= '9') {
+        priority = priority * 10 + (arg[i++] - '0');
+    }
+    while (arg[i] == ' ') i++;
+    while (arg[i] >= '0' && arg[i] <= '9') {
+        ms = ms * 10 + (arg[i++] - '0');
+    }
     
-    // Update process timer (simulate 10ms timer)
-    process_timer_tick(10);
+    if (i == 0 || ms == 0 || priority >= PROCESS_PRIORITY_LEVELS) {
+        uart_puts("Usage: slice <priority 0-31> <ms>\n");
+        return;
+    }
     
-    // Schedule processes every 10 ticks (100ms)
-    if (tick_count % 10 == 0) {
-        process_schedule();
+    process_set_time_slice(priority, ms);
+    
+    char buf[16];
+    uart_puts("Priority ");
+    int_to_str(priority, buf);
+    uart_puts(buf);
+    uart_puts(" time slice: ");
+    int_to_str(process_get_time_slice(priority), buf);
+    uart_puts(buf);
+    uart_puts(" ms\n");
+    if (process_get_sched_class() == SCHED_FAIR) {
+        uart_puts("(Used by the priority scheduler; boot with sched=rr)\n");
+    }
+}
+
+// Command to sleep the shell: sleep <ms>. Reports how long it really slept.
+void cmd_sleep(const char* arg) {
+    unsigned int ms = 0;
+    for (int i = 0; arg[i] >= '0' && arg[i] <= '9'; i++) {
+        ms = ms * 10 + (arg[i] - '0');
+    }
+    if (ms == 0) {
+        uart_puts("Usage: sleep <ms>\n");
+        return;
     }
     
-    tick_count++;
+    unsigned int start = timer_read();
+    process_sleep(ms);
+    unsigned int slept_us = timer_ticks_to_us(timer_read() - start);
+    
+    char buf[16];
+    uart_puts("Slept ");
+    int_to_str(slept_us / 1000, buf);
+    uart_puts(buf);
+    uart_puts(".");
+    int_to_str(slept_us % 1000 / 100, buf);
+    uart_puts(buf);
+    uart_puts(" ms\n");
 }
 
 // Simple text-based kernel using only UART for I/O
@@ -1297,35 +1495,56 @@ extern "C" void _start_cpp() {
     uart_puts("This version uses only UART for I/O.\n");
     uart_puts("The display initialization is skipped.\n\n");
     
-    // Initialize memory management
+    // Initialize memory management (boot allocations come from the boot arena)
     memory_init();
-    use_old_malloc = true; // Use old malloc for initial filesystem setup
+    
+    // Identity map RAM as cacheable and turn on the caches
+    mmu_init(memory_get_stats().ram_size);
+    
+    // Set up the DMA controller for bulk copies and UART output
+    dma_init();
     
     // Initialize filesystem
     fs_init();
     
-    // Switch to new memory management
-    use_old_malloc = false;
+    // Initialize process management. The fair scheduler is the default;
+    // "sched=rr" on the command line selects the strict priority one.
+    process_init(atag_cmdline_has("sched=rr") ? SCHED_PRIORITY : SCHED_FAIR);
     
-    // Initialize process management
-    process_init();
+    // Scratch memory for the shell
+    shell_arena = arena_create(SHELL_ARENA_SIZE);
+    if (shell_arena == NULL) {
+        uart_puts("Cannot allocate shell memory\nSystem halted.\n");
+        while (1);
+    }
+    
+    // Boot is done; hand the rest of the boot arena to the heap
+    memory_boot_finish();
+    
+    // Install the exception vectors and start preempting on the timer interrupt
+    irq_init();
+    process_start_preemption();
+    irq_enable();
     
     uart_puts("Starting simple UART shell...\n");
     uart_puts("Type 'help' for available commands.\n");
     
-    // Initialize cmd buffer
-    char cmd[64];
-    for (int i = 0; i < 64; i++) cmd[i] = 0;
     int cmd_pos = 0;
     
-    // For parsing commands with arguments
-    char cmd_name[32];
-    char cmd_arg[32];
-    
     // Simple UART shell
     while (1) {
-        // Simulate a timer tick (would be hardware interrupt in a real OS)
-        simulate_timer_tick();
+        // Everything from the previous command is garbage now
+        arena_reset(shell_arena);
+        
+        // Command buffer and parsed command name/argument
+        char* cmd = (char*)arena_alloc(shell_arena, MAX_CMD_LENGTH);
+        char* cmd_name = (char*)arena_alloc(shell_arena, 32);
+        char* cmd_arg = (char*)arena_alloc(shell_arena, 32);
+        if (cmd == NULL || cmd_name == NULL || cmd_arg == NULL) {
+            // The arena was just reset, so it is simply too small
+            uart_puts("Shell arena too small for command buffers\nSystem halted.\n");
+            while (1);
+        }
         
         // Show prompt with current directory
         cmd_pwd(current_path);
@@ -1334,9 +1553,9 @@ extern "C" void _start_cpp() {
         
         // Read command
         cmd_pos = 0;
-        for (int i = 0; i < 64; i++) cmd[i] = 0;
-        for (int i = 0; i < 32; i++) cmd_name[i] = 0;
-        for (int i = 0; i < 32; i++) cmd_arg[i] = 0;
+        memset(cmd, 0, MAX_CMD_LENGTH);
+        memset(cmd_name, 0, 32);
+        memset(cmd_arg, 0, 32);
         
         while (1) {
             char c = uart_getc();
@@ -1355,7 +1574,7 @@ extern "C" void _start_cpp() {
                     cmd_pos--;
                     uart_puts("\b \b"); // Erase character
                 }
-            } else if (cmd_pos < 63) {
+            } else if (cmd_pos < MAX_CMD_LENGTH - 1) {
                 uart_putc(c);
                 cmd[cmd_pos++] = c;
             }
@@ -1420,9 +1639,23 @@ extern "C" void _start_cpp() {
             uart_puts("======== System Management ========\n");
             uart_puts("  monitor  - Start system monitor\n");
             uart_puts("  memdump  - Show memory statistics\n");
+            uart_puts("  heapbench - Benchmark heap free latency\n");
+            uart_puts("  memprof  - Show allocation profile\n");
+            uart_puts("  compact  - Compact movable heap blocks\n");
+            uart_puts("  cachebench - Compare throughput with caches off and on\n");
+            uart_puts("  strbench - Benchmark string and memory functions\n");
+            uart_puts("  dmabench - Compare CPU and DMA copies\n");
+            uart_puts("  ctxbench - Measure the cost of a context switch\n");
+            uart_puts("  procstress [count] - Time process create/lookup/terminate as the table grows\n");
+            uart_puts("  timerbench - Arm 10000 timers and measure expiry jitter\n");
+            uart_puts("  sleep <ms> - Sleep the shell on a kernel timer\n");
+            uart_puts("  syncbench - Time semaphore hand-offs and test priority inheritance\n");
+            uart_puts("  locks    - Show semaphores and mutexes with contention counters\n");
             uart_puts("  ps       - List processes\n");
-            uart_puts("  testproc - Create a test process\n");
+            uart_puts("  testproc [priority] - Create a test process\n");
+            uart_puts("  rtproc <period> <budget> - Create a periodic real-time (EDF) process\n");
             uart_puts("  kill <pid> - Terminate a process\n");
+            uart_puts("  slice <priority> <ms> - Set the time slice of a priority level\n");
             uart_puts("  exit     - Quit (halt system)\n");
         } else if (strcmp(cmd_name, "version") == 0) {
             uart_puts("JasOS Kernel v0.2 (UART ONLY)\n");
@@ -1433,8 +1666,36 @@ extern "C" void _start_cpp() {
         } else if (strcmp(cmd_name, "info") == 0) {
             uart_puts("JasOS Kernel Information:\n");
             uart_puts("  Version: 0.2 (UART ONLY)\n");
-            uart_puts("  Memory: 256 KB heap\n");
-            uart_puts("  Processes: Max 16 processes\n");
+            MemoryStats mem = memory_get_stats();
+            char buf[16];
+            uart_puts("  Memory: ");
+            int_to_str(mem.ram_size / 1024, buf);
+            uart_puts(buf);
+            uart_puts(" KB RAM, ");
+            int_to_str(mem.total_memory / 1024, buf);
+            uart_puts(buf);
+            uart_puts(" KB heap (grows to ");
+            int_to_str(mem.heap_limit / 1024, buf);
+            uart_puts(buf);
+            uart_puts(" KB), ");
+            int_to_str(mem.pages_total * (PAGE_SIZE / 1024), buf);
+            uart_puts(buf);
+            uart_puts(" KB page pool\n");
+            uart_puts("  MMU: ");
+            uart_puts(mmu_enabled() ? "on" : "off");
+            uart_puts(", caches: ");
+            uart_puts(cache_enabled() ? "on\n" : "off\n");
+            uart_puts("  DMA: ");
+            uart_puts(dma_available() ? "PL080, 8 channels\n" : "not found\n");
+            uart_puts("  Processes: Max ");
+            int_to_str(PROCESS_MAX_PIDS, buf);
+            uart_puts(buf);
+            uart_puts(", room for ");
+            int_to_str(process_capacity(), buf);
+            uart_puts(buf);
+            uart_puts(" more (slab PCBs, page stacks, hashed PID/name lookup), preemptive ");
+            uart_puts(process_get_sched_class() == SCHED_FAIR ? "fair-share scheduling (vruntime)\n"
+                                                              : "priority scheduling (32 levels)\n");
             uart_puts("  Filesystem: Simple in-memory filesystem\n");
         } else if (strcmp(cmd_name, "ls") == 0) {
             cmd_ls();
@@ -1461,10 +1722,43 @@ extern "C" void _start_cpp() {
             cmd_monitor();
         } else if (strcmp(cmd_name, "memdump") == 0) {
             memory_dump();
+        } else if (strcmp(cmd_name, "heapbench") == 0) {
+            memory_benchmark();
+        } else if (strcmp(cmd_name, "memprof") == 0) {
+            memory_profile_dump();
+        } else if (strcmp(cmd_name, "compact") == 0) {
+            cmd_compact();
+        } else if (strcmp(cmd_name, "cachebench") == 0) {
+            cache_benchmark();
+        } else if (strcmp(cmd_name, "strbench") == 0) {
+            string_benchmark();
+        } else if (strcmp(cmd_name, "dmabench") == 0) {
+            dma_benchmark();
+        } else if (strcmp(cmd_name, "ctxbench") == 0) {
+            process_benchmark();
+        } else if (strcmp(cmd_name, "procstress") == 0) {
+            // Optional process count, 1000 by default (cut to what the page pool holds)
+            unsigned int count = 0;
+            for (int i = 0; cmd_arg[i] >= '0' && cmd_arg[i] <= '9'; i++) {
+                count = count * 10 + (cmd_arg[i] - '0');
+            }
+            process_stress(count ? count : 1000);
+        } else if (strcmp(cmd_name, "timerbench") == 0) {
+            ktimer_benchmark();
+        } else if (strcmp(cmd_name, "sleep") == 0) {
+            cmd_sleep(cmd_arg);
+        } else if (strcmp(cmd_name, "syncbench") == 0) {
+            sync_benchmark();
+        } else if (strcmp(cmd_name, "locks") == 0) {
+            sync_dump();
         } else if (strcmp(cmd_name, "ps") == 0) {
             process_dump();
         } else if (strcmp(cmd_name, "testproc") == 0) {
-            cmd_testproc();
+            cmd_testproc(cmd_arg);
+        } else if (strcmp(cmd_name, "rtproc") == 0) {
+            cmd_rtproc(cmd_arg);
+        } else if (strcmp(cmd_name, "slice") == 0) {
+            cmd_slice(cmd_arg);
         } else if (strcmp(cmd_name, "kill") == 0) {
             // Convert arg to integer
             int pid = 0;
@@ -1472,6 +1766,11 @@ extern "C" void _start_cpp() {
                 pid = pid * 10 + (cmd_arg[i] - '0');
             }
             
+            if (pid == 0) {
+                uart_puts("Cannot kill the idle process\n");
+                continue;
+            }
+            
             process_terminate(pid);
             uart_puts("Process ");
             for (i = 0; cmd_arg[i] >= '0' && cmd_arg[i] <= '9'; i++) {
@@ -1485,99 +1784,3 @@ extern "C" void _start_cpp() {
         }
     }
 }
-
-// Standard library function implementations
-int strcmp(const char* s1, const char* s2) {
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
-}
-
-void* memset(void* s, int c, unsigned int n) {
-    unsigned char* p = (unsigned char*)s;
-    while (n--) {
-        *p++ = (unsigned char)c;
-    }
-    return s;
-}
-
-char* strcpy(char* dest, const char* src) {
-    char* d = dest;
-    while ((*d++ = *src++) != 0);
-    return dest;
-}
-
-char* strcat(char* dest, const char* src) {
-    char* d = dest;
-    // Find the end of the destination string
-    while (*d) d++;
-    // Copy the source string
-    while ((*d++ = *src++) != 0);
-    return dest;
-}
-
-int strlen(const char* str) {
-    int len = 0;
-    while (str[len]) {
-        len++;
-    }
-    return len;
-}
-
-char* strtok(char* str, const char* delim) {
-    static char* last_token = NULL;
-    
-    // If str is NULL, continue from last token
-    if (str == NULL) {
-        str = last_token;
-    }
-    
-    // Skip leading delimiters
-    while (*str != 0) {
-        bool is_delim = false;
-        for (int i = 0; delim[i] != 0; i++) {
-            if (*str == delim[i]) {
-                is_delim = true;
-                break;
-            }
-        }
-        
-        if (!is_delim) {
-            break;
-        }
-        
-        str++;
-    }
-    
-    // If we reached the end of the string, return NULL
-    if (*str == 0) {
-        last_token = str;
-        return NULL;
-    }
-    
-    // Find the end of the token
-    char* token_start = str;
-    while (*str != 0) {
-        bool is_delim = false;
-        for (int i = 0; delim[i] != 0; i++) {
-            if (*str == delim[i]) {
-                is_delim = true;
-                break;
-            }
-        }
-        
-        if (is_delim) {
-            *str = 0;
-            last_token = str + 1;
-            return token_start;
-        }
-        
-        str++;
-    }
-    
-    // We reached the end of the string
-    last_token = str;
-    return token_start;
-}
\ No newline at end of file
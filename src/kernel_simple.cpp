@@ -1,16 +1,23 @@
 #include "uart.hpp"
 #include "memory.hpp"
 #include "process.hpp"
-
-// Forward declarations for standard functions
-int strcmp(const char* s1, const char* s2);
-void* memset(void* s, int c, unsigned int n);
+#include "kstring.hpp"
 
 // Define NULL if not defined
 #ifndef NULL
 #define NULL 0
 #endif
 
+// Test process: some busy work, yielding in between
+void test_process() {
+    for (int i = 0; i < 1000; i++) {
+        for (volatile int j = 0; j < 10000; j++) {
+            // Busy work
+        }
+        process_yield();
+    }
+}
+
 // Simple version of kernel with minimal shell for testing input
 extern "C" void _start_cpp() {
     // Initialize UART
@@ -26,8 +33,12 @@ extern "C" void _start_cpp() {
     // Initialize memory management
     memory_init();
     
-    // Initialize process management
-    process_init();
+    // Initialize process management. There is no timer here to account
+    // virtual runtime with, so processes take turns by priority.
+    process_init(SCHED_PRIORITY);
+    
+    // Boot is done; hand the rest of the boot arena to the heap
+    memory_boot_finish();
     
     uart_puts("Starting simple shell...\n");
     uart_puts("Commands: help, memory, process, exit\n\n");
@@ -46,7 +57,7 @@ extern "C" void _start_cpp() {
         
         while (1) {
             // Process scheduling - only once per command, not in inner loop
-            process_schedule();
+            process_yield();
             
             // Get character
             char c = uart_getc();
@@ -81,7 +92,7 @@ extern "C" void _start_cpp() {
         } else if (strcmp(buffer, "process") == 0) {
             process_dump();
         } else if (strcmp(buffer, "test") == 0) {
-            int pid = process_create("test", NULL, 1);
+            int pid = process_create("test", test_process, 1);
             uart_puts("Created test process with PID ");
             
             // Convert PID to string
@@ -121,20 +132,3 @@ extern "C" void _start_cpp() {
         }
     }
 }
-
-// Standard library function implementations
-int strcmp(const char* s1, const char* s2) {
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
-}
-
-void* memset(void* s, int c, unsigned int n) {
-    unsigned char* p = (unsigned char*)s;
-    while (n--) {
-        *p++ = (unsigned char)c;
-    }
-    return s;
-} 
\ No newline at end of file
@@ -0,0 +1,363 @@
+#include "kstring.hpp"
+#include "memory.hpp"
+#include "timer.hpp"
+#include "uart.hpp"
+
+/*
+ * Word-at-a-time string routines
+ * Once a pointer is word aligned, strings are scanned four bytes per load.
+ * An aligned word never straddles a page, so reading the bytes after the
+ * terminator is harmless. On ARMv6 and later (the arm1176 build) zero
+ * bytes are found with UQSUB8, and strcmp folds the difference and
+ * terminator tests into one UADD8/SEL pair.
+ */
+
+// Define NULL if not defined
+#ifndef NULL
+#define NULL 0
+#endif
+
+void int_to_str(unsigned int num, char* str);
+
+#if defined(__ARM_ARCH) && __ARM_ARCH >= 6
+#define KSTRING_ARMV6 1
+#endif
+
+// Byte-replicated constants
+#define ONES  0x01010101u
+#define HIGHS 0x80808080u
+
+// Word type that may alias the characters it is loaded from
+typedef unsigned int __attribute__((may_alias)) word_t;
+
+// Non-zero if any byte of w is zero. The lowest flagged byte is always the first zero.
+static inline unsigned int zero_bytes(unsigned int w) {
+#ifdef KSTRING_ARMV6
+    unsigned int r;
+    // Saturating 1 - byte leaves 1 exactly where the byte was zero
+    asm("uqsub8 %0, %1, %2" : "=r"(r) : "r"(ONES), "r"(w));
+    return r;
+#else
+    return (w - ONES) & ~w & HIGHS;
+#endif
+}
+
+// Non-zero if the words differ or the first one holds the terminator
+static inline unsigned int compare_syndrome(unsigned int w1, unsigned int w2) {
+#ifdef KSTRING_ARMV6
+    unsigned int r;
+    // GE is set for each non-zero byte of w1; SEL takes the XOR there and 0xFF elsewhere
+    asm("uadd8 %0, %1, %3\n\t"
+        "sel %0, %2, %3"
+        : "=&r"(r) : "r"(w1), "r"(w1 ^ w2), "r"(0xFFFFFFFFu));
+    return r;
+#else
+    return (w1 ^ w2) | zero_bytes(w1);
+#endif
+}
+
+// Byte offset of the lowest flagged byte in a mask
+static inline unsigned int first_byte(unsigned int mask) {
+    return __builtin_ctz(mask) >> 3;
+}
+
+// Check whether a pointer is word aligned
+static inline bool word_aligned(const void* p) {
+    return (reinterpret_cast<unsigned long>(p) & 3) == 0;
+}
+
+int strlen(const char* str) {
+    const char* p = str;
+    while (!word_aligned(p)) {
+        if (*p == 0) {
+            return p - str;
+        }
+        p++;
+    }
+    
+    const word_t* w = reinterpret_cast<const word_t*>(p);
+    unsigned int zeros;
+    while ((zeros = zero_bytes(*w)) == 0) {
+        w++;
+    }
+    return reinterpret_cast<const char*>(w) - str + first_byte(zeros);
+}
+
+int strcmp(const char* s1, const char* s2) {
+    // Compare a word at a time when both strings share their alignment
+    if (((reinterpret_cast<unsigned long>(s1) ^ reinterpret_cast<unsigned long>(s2)) & 3) == 0) {
+        while (!word_aligned(s1)) {
+            if (*s1 == 0 || *s1 != *s2) {
+                return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+            }
+            s1++;
+            s2++;
+        }
+        
+        const word_t* w1 = reinterpret_cast<const word_t*>(s1);
+        const word_t* w2 = reinterpret_cast<const word_t*>(s2);
+        while (compare_syndrome(*w1, *w2) == 0) {
+            w1++;
+            w2++;
+        }
+        
+        // The answer is inside these words
+        s1 = reinterpret_cast<const char*>(w1);
+        s2 = reinterpret_cast<const char*>(w2);
+    }
+    
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+void* memchr(const void* s, int c, unsigned int n) {
+    const unsigned char* p = (const unsigned char*)s;
+    unsigned char ch = (unsigned char)c;
+    
+    while (n && !word_aligned(p)) {
+        if (*p == ch) {
+            return (void*)p;
+        }
+        p++;
+        n--;
+    }
+    
+    // A byte equal to ch becomes a zero byte after XOR with the pattern
+    unsigned int pattern = ch * ONES;
+    const word_t* w = reinterpret_cast<const word_t*>(p);
+    while (n >= 4) {
+        unsigned int matches = zero_bytes(*w ^ pattern);
+        if (matches) {
+            return (void*)(reinterpret_cast<const unsigned char*>(w) + first_byte(matches));
+        }
+        w++;
+        n -= 4;
+    }
+    
+    p = reinterpret_cast<const unsigned char*>(w);
+    while (n--) {
+        if (*p == ch) {
+            return (void*)p;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+char* strcpy(char* dest, const char* src) {
+    char* d = dest;
+    
+    // Copy whole words until the one holding the terminator
+    if (((reinterpret_cast<unsigned long>(d) ^ reinterpret_cast<unsigned long>(src)) & 3) == 0) {
+        while (!word_aligned(src)) {
+            if ((*d++ = *src++) == 0) {
+                return dest;
+            }
+        }
+        
+        word_t* wd = reinterpret_cast<word_t*>(d);
+        const word_t* ws = reinterpret_cast<const word_t*>(src);
+        while (zero_bytes(*ws) == 0) {
+            *wd++ = *ws++;
+        }
+        d = reinterpret_cast<char*>(wd);
+        src = reinterpret_cast<const char*>(ws);
+    }
+    
+    while ((*d++ = *src++) != 0);
+    return dest;
+}
+
+char* strcat(char* dest, const char* src) {
+    strcpy(dest + strlen(dest), src);
+    return dest;
+}
+
+char* strtok(char* str, const char* delim) {
+    static char* last_token = NULL;
+    
+    // If str is NULL, continue from last token
+    if (str == NULL) {
+        str = last_token;
+    }
+    
+    // Skip leading delimiters
+    while (*str != 0) {
+        bool is_delim = false;
+        for (int i = 0; delim[i] != 0; i++) {
+            if (*str == delim[i]) {
+                is_delim = true;
+                break;
+            }
+        }
+        
+        if (!is_delim) {
+            break;
+        }
+        
+        str++;
+    }
+    
+    // If we reached the end of the string, return NULL
+    if (*str == 0) {
+        last_token = str;
+        return NULL;
+    }
+    
+    // Find the end of the token
+    char* token_start = str;
+    while (*str != 0) {
+        bool is_delim = false;
+        for (int i = 0; delim[i] != 0; i++) {
+            if (*str == delim[i]) {
+                is_delim = true;
+                break;
+            }
+        }
+        
+        if (is_delim) {
+            *str = 0;
+            last_token = str + 1;
+            return token_start;
+        }
+        
+        str++;
+    }
+    
+    // We reached the end of the string
+    last_token = str;
+    return token_start;
+}
+
+// Byte-loop versions for comparison. GCC must not turn them back into library calls.
+#define BYTE_LOOP __attribute__((noinline, optimize("no-tree-loop-distribute-patterns")))
+
+BYTE_LOOP static void byte_memset(unsigned char* s, int c, unsigned int n) {
+    while (n--) {
+        *s++ = (unsigned char)c;
+    }
+}
+
+BYTE_LOOP static void byte_memcpy(unsigned char* d, const unsigned char* s, unsigned int n) {
+    while (n--) {
+        *d++ = *s++;
+    }
+}
+
+BYTE_LOOP static int byte_strlen(const char* s) {
+    int len = 0;
+    while (s[len]) {
+        len++;
+    }
+    return len;
+}
+
+BYTE_LOOP static int byte_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+BYTE_LOOP static const void* byte_memchr(const unsigned char* s, int c, unsigned int n) {
+    while (n--) {
+        if (*s == (unsigned char)c) {
+            return s;
+        }
+        s++;
+    }
+    return NULL;
+}
+
+// Number of benchmarked functions
+#define BENCH_FUNCTIONS 5
+
+// Run one function over a buffer of the given size, optimized or byte loop
+static void bench_run(int function, bool optimized, unsigned char* a, unsigned char* b, unsigned int size) {
+    volatile unsigned int sink = 0;
+    switch (function) {
+    case 0:
+        if (optimized) memset(a, 0x41, size);
+        else byte_memset(a, 0x41, size);
+        break;
+    case 1:
+        if (optimized) memcpy(a, b, size);
+        else byte_memcpy(a, b, size);
+        break;
+    case 2:
+        sink = optimized ? strlen((const char*)b) : byte_strlen((const char*)b);
+        break;
+    case 3:
+        sink = optimized ? strcmp((const char*)a, (const char*)b) : byte_strcmp((const char*)a, (const char*)b);
+        break;
+    case 4:
+        sink = (optimized ? memchr(b, 0x7F, size) : byte_memchr(b, 0x7F, size)) != NULL;
+        break;
+    }
+    (void)sink;
+}
+
+// Measure throughput in KB/ms (roughly MB/s) over 256 KB of work
+static unsigned int bench_throughput(int function, bool optimized, unsigned char* a, unsigned char* b, unsigned int size) {
+    const unsigned int total = 256 * 1024;
+    
+    // Strings of size - 1 characters for the string functions
+    memset(b, 'x', size - 1);
+    b[size - 1] = 0;
+    memcpy(a, b, size);
+    
+    unsigned int start = timer_read();
+    for (unsigned int done = 0; done < total; done += size) {
+        bench_run(function, optimized, a, b, size);
+    }
+    unsigned int us = timer_ticks_to_us(timer_read() - start);
+    if (us == 0) {
+        us = 1;
+    }
+    return ((total / 1024) * 1000) / us;
+}
+
+// Compare the optimized string and memory functions with byte loops
+void string_benchmark() {
+    const unsigned int sizes[] = { 16, 256, 4096 };
+    const char* names[BENCH_FUNCTIONS] = { "memset", "memcpy", "strlen", "strcmp", "memchr" };
+    char buf[16];
+    
+    unsigned char* a = (unsigned char*)memory_alloc_aligned(4096, CACHE_LINE_SIZE);
+    unsigned char* b = (unsigned char*)memory_alloc_aligned(4096, CACHE_LINE_SIZE);
+    if (!a || !b) {
+        uart_puts("Out of memory\n");
+        memory_free(a);
+        memory_free(b);
+        return;
+    }
+    
+    uart_puts("String/memory throughput in KB/ms:\n");
+    uart_puts("  FUNCTION  SIZE    BYTE LOOP   OPTIMIZED\n");
+    for (int f = 0; f < BENCH_FUNCTIONS; f++) {
+        for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            unsigned int slow = bench_throughput(f, false, a, b, sizes[s]);
+            unsigned int fast = bench_throughput(f, true, a, b, sizes[s]);
+            
+            uart_puts("  ");
+            uart_puts(names[f]);
+            for (int pad = strlen(names[f]); pad < 10; pad++) uart_putc(' ');
+            int_to_str(sizes[s], buf);
+            uart_puts(buf);
+            for (int pad = strlen(buf); pad < 8; pad++) uart_putc(' ');
+            int_to_str(slow, buf);
+            uart_puts(buf);
+            for (int pad = strlen(buf); pad < 12; pad++) uart_putc(' ');
+            int_to_str(fast, buf);
+            uart_puts(buf);
+            uart_puts("\n");
+        }
+    }
+    
+    memory_free(a);
+    memory_free(b);
+}
@@ -0,0 +1,21 @@
+#ifndef KSTRING_HPP
+#define KSTRING_HPP
+
+// Kernel string and memory library. The functions have C linkage so the
+// memset/memcpy calls the compiler emits for struct copies resolve here.
+// memset, memcpy and memmove are in kstring_asm.s.
+extern "C" {
+void* memset(void* s, int c, unsigned int n);
+void* memcpy(void* dest, const void* src, unsigned int n);
+void* memmove(void* dest, const void* src, unsigned int n);
+void* memchr(const void* s, int c, unsigned int n);
+int strlen(const char* str);
+int strcmp(const char* s1, const char* s2);
+char* strcpy(char* dest, const char* src);
+char* strcat(char* dest, const char* src);
+char* strtok(char* str, const char* delim);
+}
+
+void string_benchmark();
+
+#endif // KSTRING_HPP
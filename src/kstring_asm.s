@@ -0,0 +1,141 @@
+/*
+ * Block memory primitives (ARM state, ARMv4T and later)
+ * Large aligned transfers move 32 bytes per LDM/STM pair; the head and
+ * tail are handled a word and then a byte at a time.
+ */
+
+.syntax unified
+.arm
+.text
+
+@ void* memset(void* s, int c, unsigned int n)
+.global memset
+.type memset, %function
+memset:
+    mov     r12, r0                 @ Return the original pointer
+    and     r1, r1, #0xFF
+    cmp     r2, #8
+    blo     .Lset_tail              @ Short fills go byte by byte
+    orr     r1, r1, r1, lsl #8      @ Replicate the byte into a word
+    orr     r1, r1, r1, lsl #16
+.Lset_align:
+    tst     r0, #3
+    beq     .Lset_words
+    strb    r1, [r0], #1
+    sub     r2, r2, #1
+    b       .Lset_align
+.Lset_words:
+    push    {r4-r9}
+    mov     r3, r1
+    mov     r4, r1
+    mov     r5, r1
+    mov     r6, r1
+    mov     r7, r1
+    mov     r8, r1
+    mov     r9, r1
+    subs    r2, r2, #32
+    blo     2f
+1:  stmia   r0!, {r1, r3-r9}
+    subs    r2, r2, #32
+    bhs     1b
+2:  pop     {r4-r9}
+    adds    r2, r2, #32             @ 0-31 bytes left
+3:  subs    r2, r2, #4
+    strhs   r1, [r0], #4
+    bhs     3b
+    add     r2, r2, #4
+.Lset_tail:
+    subs    r2, r2, #1
+    strbhs  r1, [r0], #1
+    bhs     .Lset_tail
+    mov     r0, r12
+    bx      lr
+.size memset, . - memset
+
+@ void* memcpy(void* dest, const void* src, unsigned int n)
+.global memcpy
+.type memcpy, %function
+memcpy:
+    mov     r12, r0                 @ Return the original destination
+    cmp     r2, #8
+    blo     .Lcpy_tail              @ Short copies go byte by byte
+    eor     r3, r0, r1
+    tst     r3, #3
+    bne     .Lcpy_tail              @ Pointers can never both be word aligned
+.Lcpy_align:
+    tst     r0, #3
+    beq     .Lcpy_words
+    ldrb    r3, [r1], #1
+    strb    r3, [r0], #1
+    sub     r2, r2, #1
+    b       .Lcpy_align
+.Lcpy_words:
+    push    {r4-r10}
+    subs    r2, r2, #32
+    blo     2f
+1:  ldmia   r1!, {r3-r10}
+    stmia   r0!, {r3-r10}
+    subs    r2, r2, #32
+    bhs     1b
+2:  pop     {r4-r10}
+    adds    r2, r2, #32             @ 0-31 bytes left
+3:  subs    r2, r2, #4
+    ldrhs   r3, [r1], #4
+    strhs   r3, [r0], #4
+    bhs     3b
+    add     r2, r2, #4
+.Lcpy_tail:
+    subs    r2, r2, #1
+    ldrbhs  r3, [r1], #1
+    strbhs  r3, [r0], #1
+    bhs     .Lcpy_tail
+    mov     r0, r12
+    bx      lr
+.size memcpy, . - memcpy
+
+@ void* memmove(void* dest, const void* src, unsigned int n)
+.global memmove
+.type memmove, %function
+memmove:
+    @ Copying forwards is safe unless dest lies inside [src, src + n)
+    sub     r3, r0, r1
+    cmp     r3, r2
+    bhs     memcpy
+    mov     r12, r0
+    add     r0, r0, r2              @ Copy backwards from the end
+    add     r1, r1, r2
+    cmp     r2, #8
+    blo     .Lmove_tail
+    eor     r3, r0, r1
+    tst     r3, #3
+    bne     .Lmove_tail
+.Lmove_align:
+    tst     r0, #3
+    beq     .Lmove_words
+    ldrb    r3, [r1, #-1]!
+    strb    r3, [r0, #-1]!
+    sub     r2, r2, #1
+    b       .Lmove_align
+.Lmove_words:
+    push    {r4-r10}
+    subs    r2, r2, #32
+    blo     2f
+1:  ldmdb   r1!, {r3-r10}
+    stmdb   r0!, {r3-r10}
+    subs    r2, r2, #32
+    bhs     1b
+2:  pop     {r4-r10}
+    adds    r2, r2, #32             @ 0-31 bytes left
+3:  subs    r2, r2, #4
+    ldrhs   r3, [r1, #-4]!
+    strhs   r3, [r0, #-4]!
+    bhs     3b
+    add     r2, r2, #4
+.Lmove_tail:
+    subs    r2, r2, #1
+    ldrbhs  r3, [r1, #-1]!
+    strbhs  r3, [r0, #-1]!
+    bhs     .Lmove_tail
+    mov     r0, r12
+    bx      lr
+.size memmove, . - memmove
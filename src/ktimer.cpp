@@ -0,0 +1,395 @@
+#include "ktimer.hpp"
+#include "process.hpp"
+#include "memory.hpp"
+#include "timer.hpp"
+#include "irq.hpp"
+#include "uart.hpp"
+
+/*
+ * Hierarchical timer wheel
+ * The root level has a slot for each of the next 256 ticks. Each coarser
+ * level has 64 slots covering 64 turns of the level below; when a level
+ * wraps, the next slot of the level above is emptied into it (cascaded).
+ * A timer is cascaded at most once per level, so arming, cancelling and
+ * expiring are all constant time. The wheel advances one tick per timer
+ * interrupt, or several at once after a tickless sleep.
+ */
+
+// Forward declarations
+void int_to_str(unsigned int num, char* str);
+
+// Define NULL if not defined
+#ifndef NULL
+#define NULL 0
+#endif
+
+#define ROOT_SIZE (1u << KTIMER_ROOT_BITS)
+#define LEVEL_SIZE (1u << KTIMER_LEVEL_BITS)
+#define SLOT_COUNT (ROOT_SIZE + (KTIMER_LEVELS - 1) * LEVEL_SIZE)
+
+// Timers in the benchmark, and the range of their delays
+#define BENCH_TIMERS 10000
+#define BENCH_MAX_DELAY_MS 3000
+
+// Timers by slot: the root level first, then 64 slots per coarser level
+static KTimer* wheel[SLOT_COUNT];
+// Non-empty root slots, to find the next expiry for tickless idle
+static unsigned int root_bitmap[ROOT_SIZE / 32];
+// Timers above the root level
+static unsigned int upper_count = 0;
+// Next tick to run
+static unsigned int wheel_tick = 0;
+// Statistics
+static unsigned int pending_count = 0;
+static unsigned int armed_count = 0;
+static unsigned int cancelled_count = 0;
+static unsigned int expired_count = 0;
+static unsigned int cascaded_count = 0;
+static unsigned int max_tick_ticks = 0;
+
+// First slot of a level above the root
+static inline unsigned int level_base(unsigned int level) {
+    return ROOT_SIZE + (level - 1) * LEVEL_SIZE;
+}
+
+// Slot index of a tick within a level above the root
+static inline unsigned int level_index(unsigned int tick, unsigned int level) {
+    return (tick >> (KTIMER_ROOT_BITS + (level - 1) * KTIMER_LEVEL_BITS)) & (LEVEL_SIZE - 1);
+}
+
+// Put a timer in the slot for its expiry, relative to the next tick to run
+static void wheel_insert(KTimer* timer) {
+    unsigned int expires = timer->expires;
+    unsigned int delta = expires - wheel_tick;
+    unsigned int slot;
+    
+    if ((int)delta < 0) {
+        // Already due: run it with the next tick
+        slot = wheel_tick & (ROOT_SIZE - 1);
+    } else if (delta < ROOT_SIZE) {
+        slot = expires & (ROOT_SIZE - 1);
+    } else {
+        unsigned int level = 1;
+        while (level < KTIMER_LEVELS - 1 && delta >= 1u << (KTIMER_ROOT_BITS + level * KTIMER_LEVEL_BITS)) {
+            level++;
+        }
+        slot = level_base(level) + level_index(expires, level);
+    }
+    
+    if (slot < ROOT_SIZE) {
+        root_bitmap[slot / 32] |= 1u << (slot % 32);
+    } else {
+        upper_count++;
+    }
+    
+    timer->slot = slot;
+    timer->next = wheel[slot];
+    if (timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = &wheel[slot];
+    wheel[slot] = timer;
+}
+
+// Take a timer out of its slot, or out of a list being run or cascaded
+static void wheel_remove(KTimer* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->pprev = NULL;
+    
+    unsigned int slot = timer->slot;
+    if (slot >= ROOT_SIZE) {
+        upper_count--;
+    } else if (wheel[slot] == NULL) {
+        root_bitmap[slot / 32] &= ~(1u << (slot % 32));
+    }
+}
+
+// Detach a slot's list so it can be run or cascaded. The head's back-link
+// moves to the caller's variable, so timers can still be cancelled from it.
+static KTimer* wheel_take(unsigned int slot, KTimer** list) {
+    *list = wheel[slot];
+    wheel[slot] = NULL;
+    if (*list != NULL) {
+        (*list)->pprev = list;
+    }
+    if (slot < ROOT_SIZE) {
+        root_bitmap[slot / 32] &= ~(1u << (slot % 32));
+    }
+    return *list;
+}
+
+// Move every timer in a slot of a coarser level down to where it now belongs
+static void wheel_cascade(unsigned int slot) {
+    KTimer* list;
+    wheel_take(slot, &list);
+    while (list != NULL) {
+        KTimer* timer = list;
+        wheel_remove(timer);
+        wheel_insert(timer);
+        cascaded_count++;
+    }
+}
+
+// Empty the wheel
+void ktimer_init() {
+    for (unsigned int i = 0; i < SLOT_COUNT; i++) {
+        wheel[i] = NULL;
+    }
+    for (unsigned int i = 0; i < ROOT_SIZE / 32; i++) {
+        root_bitmap[i] = 0;
+    }
+    upper_count = 0;
+    pending_count = 0;
+}
+
+// Set the function a timer calls when it fires
+void ktimer_setup(KTimer* timer, void (*callback)(void* arg), void* arg) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->slot = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+// Fire a timer after ms milliseconds, never earlier. A pending timer is
+// moved to the new time.
+void ktimer_arm(KTimer* timer, unsigned int ms) {
+    IrqGuard guard;
+    
+    if (timer->pprev != NULL) {
+        wheel_remove(timer);
+        pending_count--;
+    }
+    
+    // The next tick may be almost here, so a whole extra one is allowed for
+    timer->expires = wheel_tick + (ms + PROCESS_TICK_MS - 1) / PROCESS_TICK_MS;
+    wheel_insert(timer);
+    pending_count++;
+    armed_count++;
+}
+
+// Stop a timer. Returns whether it was still pending.
+bool ktimer_cancel(KTimer* timer) {
+    IrqGuard guard;
+    
+    if (timer->pprev == NULL) {
+        return false;
+    }
+    wheel_remove(timer);
+    pending_count--;
+    cancelled_count++;
+    return true;
+}
+
+// Whether a timer is armed and has not fired yet
+bool ktimer_pending(const KTimer* timer) {
+    return timer->pprev != NULL;
+}
+
+// Run one tick: cascade if the root level wrapped, then fire its timers
+void ktimer_tick() {
+    unsigned int start = timer_read();
+    
+    unsigned int index = wheel_tick & (ROOT_SIZE - 1);
+    if (index == 0) {
+        // Each level cascades the one above it when it wraps too
+        for (unsigned int level = 1; level < KTIMER_LEVELS; level++) {
+            unsigned int i = level_index(wheel_tick, level);
+            wheel_cascade(level_base(level) + i);
+            if (i != 0) {
+                break;
+            }
+        }
+    }
+    wheel_tick++;
+    
+    KTimer* list;
+    wheel_take(index, &list);
+    while (list != NULL) {
+        KTimer* timer = list;
+        wheel_remove(timer);
+        pending_count--;
+        expired_count++;
+        timer->callback(timer->arg);
+    }
+    
+    unsigned int ticks = timer_read() - start;
+    if (ticks > max_tick_ticks) {
+        max_tick_ticks = ticks;
+    }
+}
+
+// Number of ticks until the wheel has something to do, up to max_ticks:
+// a root slot with timers in it, or a cascade that may bring some down
+unsigned int ktimer_next(unsigned int max_ticks) {
+    IrqGuard guard;
+    
+    unsigned int index = wheel_tick & (ROOT_SIZE - 1);
+    unsigned int next = upper_count != 0 ? (ROOT_SIZE - index) & (ROOT_SIZE - 1) : ROOT_SIZE;
+    
+    // Look for the first non-empty root slot from the next tick on, wrapping around
+    for (unsigned int n = 0; n <= ROOT_SIZE / 32; n++) {
+        unsigned int word = (index / 32 + n) % (ROOT_SIZE / 32);
+        unsigned int bits = root_bitmap[word];
+        if (n == 0) {
+            bits &= ~0u << (index % 32);
+        } else if (n == ROOT_SIZE / 32) {
+            bits &= ~(~0u << (index % 32));
+        }
+        if (bits != 0) {
+            unsigned int slot = word * 32 + __builtin_ctz(bits);
+            unsigned int ticks = (slot - index) & (ROOT_SIZE - 1);
+            if (ticks < next) {
+                next = ticks;
+            }
+            break;
+        }
+    }
+    
+    // The tick after next runs at the second tick interrupt from now
+    next++;
+    return next < max_ticks ? next : max_ticks;
+}
+
+// Get timer statistics
+KTimerStats ktimer_get_stats() {
+    KTimerStats stats;
+    IrqGuard guard;
+    
+    stats.pending = pending_count;
+    stats.armed = armed_count;
+    stats.cancelled = cancelled_count;
+    stats.expired = expired_count;
+    stats.cascaded = cascaded_count;
+    stats.max_tick_ns = timer_ticks_to_ns(max_tick_ticks);
+    return stats;
+}
+
+// Benchmark timer, with when it was armed and for how long
+struct BenchTimer {
+    KTimer timer;
+    unsigned int armed;
+    unsigned int delay_ms;
+};
+
+// Benchmark results, filled in from the tick interrupt
+static volatile unsigned int bench_fired = 0;
+static unsigned int bench_early = 0;
+static unsigned int bench_over_tick = 0;
+static unsigned int bench_late_min = 0;
+static unsigned int bench_late_max = 0;
+static unsigned int bench_late_total = 0;
+
+// Benchmark callback: how long after the requested time the timer fired
+static void bench_expired(void* arg) {
+    BenchTimer* bench = (BenchTimer*)arg;
+    unsigned int elapsed_us = timer_ticks_to_us(timer_read() - bench->armed);
+    unsigned int delay_us = bench->delay_ms * 1000;
+    
+    if (elapsed_us < delay_us) {
+        bench_early++;
+    } else {
+        unsigned int late_us = elapsed_us - delay_us;
+        if (bench_fired == bench_early || late_us < bench_late_min) {
+            bench_late_min = late_us;
+        }
+        if (late_us > bench_late_max) {
+            bench_late_max = late_us;
+        }
+        if (late_us > PROCESS_TICK_MS * 1000) {
+            bench_over_tick++;
+        }
+        bench_late_total += late_us;
+    }
+    bench_fired++;
+}
+
+// Print a labelled number with a unit
+static void bench_line(const char* label, unsigned int value, const char* unit) {
+    char buf[16];
+    uart_puts(label);
+    int_to_str(value, buf);
+    uart_puts(buf);
+    uart_puts(unit);
+}
+
+// Arm BENCH_TIMERS timers with delays spread over a few seconds, cancel
+// every tenth, and measure how far from the requested time the rest fire
+void ktimer_benchmark() {
+    BenchTimer* timers = (BenchTimer*)memory_alloc(BENCH_TIMERS * sizeof(BenchTimer));
+    if (timers == NULL) {
+        uart_puts("Out of memory\n");
+        return;
+    }
+    
+    bench_fired = 0;
+    bench_early = 0;
+    bench_over_tick = 0;
+    bench_late_min = 0;
+    bench_late_max = 0;
+    bench_late_total = 0;
+    
+    bench_line("Timer wheel benchmark (", BENCH_TIMERS, " timers, 1-");
+    bench_line("", BENCH_MAX_DELAY_MS, " ms):\n");
+    
+    // The tick keeps running while arming: a tick held off would make the
+    // wheel lag behind and timers armed meanwhile fire early
+    unsigned int seed = timer_read();
+    unsigned int arm_ticks = 0;
+    for (unsigned int i = 0; i < BENCH_TIMERS; i++) {
+        seed = seed * 1103515245 + 12345;
+        BenchTimer* bench = &timers[i];
+        bench->delay_ms = 1 + (seed >> 8) % BENCH_MAX_DELAY_MS;
+        ktimer_setup(&bench->timer, bench_expired, bench);
+        
+        unsigned int start = timer_read();
+        bench->armed = start;
+        ktimer_arm(&bench->timer, bench->delay_ms);
+        arm_ticks += timer_read() - start;
+    }
+    
+    unsigned int start = timer_read();
+    unsigned int cancelled = 0;
+    for (unsigned int i = 0; i < BENCH_TIMERS; i += 10) {
+        if (ktimer_cancel(&timers[i].timer)) {
+            cancelled++;
+        }
+    }
+    unsigned int cancel_ticks = timer_read() - start;
+    
+    // Wait for the rest, with a second to spare
+    unsigned int expected = BENCH_TIMERS - cancelled;
+    for (unsigned int waited = 0; bench_fired < expected && waited < BENCH_MAX_DELAY_MS + 1000; waited += 100) {
+        process_sleep(100);
+    }
+    
+    // Anything still pending must not fire into freed memory
+    for (unsigned int i = 0; i < BENCH_TIMERS; i++) {
+        ktimer_cancel(&timers[i].timer);
+    }
+    unsigned int fired = bench_fired;
+    unsigned int on_time = fired - bench_early;
+    
+    bench_line("  Arm:          ", timer_ticks_to_ns(arm_ticks) / BENCH_TIMERS, " ns per timer\n");
+    bench_line("  Cancel:       ", cancelled ? timer_ticks_to_ns(cancel_ticks) / cancelled : 0, " ns per timer (");
+    bench_line("", cancelled, " cancelled)\n");
+    bench_line("  Expired:      ", fired, " of ");
+    bench_line("", expected, ", ");
+    bench_line("", bench_early, " early\n");
+    bench_line("  Lateness:     min ", bench_late_min, " us, ");
+    bench_line("avg ", on_time ? bench_late_total / on_time : 0, " us, ");
+    bench_line("max ", bench_late_max, " us\n");
+    bench_line("  Jitter:       ", bench_late_max - bench_late_min, " us (a tick is ");
+    bench_line("", PROCESS_TICK_MS * 1000, " us)\n");
+    bench_line("  Over a tick:  ", bench_over_tick, " timers\n");
+    
+    KTimerStats stats = ktimer_get_stats();
+    bench_line("  Cascaded:     ", stats.cascaded, " moves since boot\n");
+    bench_line("  Longest tick: ", stats.max_tick_ns, " ns\n");
+    
+    memory_free(timers);
+}
@@ -0,0 +1,47 @@
+#ifndef KTIMER_HPP
+#define KTIMER_HPP
+
+// Wheel geometry: 256 slots of one tick, then four levels of 64 slots, each
+// slot spanning a whole turn of the level below (2^32 ticks in all)
+#define KTIMER_ROOT_BITS 8
+#define KTIMER_LEVEL_BITS 6
+#define KTIMER_LEVELS 5
+
+// Kernel timer. The callback runs from the tick interrupt with IRQs disabled
+// and may arm or cancel any timer, itself included.
+struct KTimer {
+    KTimer* next;             // Next timer in the same wheel slot
+    KTimer** pprev;           // Link that points at this timer, NULL when not armed
+    unsigned int expires;     // Wheel tick it fires on
+    unsigned int slot;        // Wheel slot it is in
+    void (*callback)(void* arg);
+    void* arg;
+};
+
+// Timer functions. Arming, cancelling and expiring cost the same however
+// many timers are pending.
+void ktimer_init();
+void ktimer_setup(KTimer* timer, void (*callback)(void* arg), void* arg);
+void ktimer_arm(KTimer* timer, unsigned int ms);
+bool ktimer_cancel(KTimer* timer);
+bool ktimer_pending(const KTimer* timer);
+
+// Driven once per tick by process_timer_tick
+void ktimer_tick();
+unsigned int ktimer_next(unsigned int max_ticks);
+
+// Timer statistics
+struct KTimerStats {
+    unsigned int pending;
+    unsigned int armed;           // Since boot
+    unsigned int cancelled;
+    unsigned int expired;
+    unsigned int cascaded;        // Moves down from a coarser level
+    unsigned int max_tick_ns;     // Longest ktimer_tick
+};
+
+KTimerStats ktimer_get_stats();
+
+void ktimer_benchmark();
+
+#endif // KTIMER_HPP
@@ -1,12 +1,17 @@
 #include "memory.hpp"
 #include "uart.hpp"
+#include "timer.hpp"
+#include "atag.hpp"
+#include "kstring.hpp"
+#include "dma.hpp"
+#include "irq.hpp"
 
-// Forward declarations for standard functions
-void* memset(void* s, int c, unsigned int n);
-int strlen(const char* s);
-
-// Heap size (256 KB)
-#define HEAP_SIZE (256 * 1024)
+// RAM size assumed when the boot loader passes no ATAG_MEM (QEMU -m 128M)
+#define DEFAULT_RAM_SIZE (128 * 1024 * 1024)
+// The heap starts at one chunk and grows towards the top of RAM in chunks
+#define HEAP_CHUNK_SIZE (256 * 1024)
+// Boot arena carved from the start of the heap for allocations made during boot
+#define BOOT_ARENA_SIZE (32 * 1024)
 // Minimum allocation size (accounting for block overhead)
 #define MIN_ALLOC_SIZE 16
 
@@ -15,10 +20,113 @@ int strlen(const char* s);
 #define NULL 0
 #endif
 
-// Heap memory
-static unsigned char heap[HEAP_SIZE];
+// Largest buddy block; the page pool is aligned to it
+#define PAGE_BLOCK_SIZE (PAGE_SIZE << PAGE_MAX_ORDER)
+// The page pool takes a quarter of the RAM after the kernel, in whole
+// maximum-order blocks, and at least 1 MB and at most 32 MB of it
+#define PAGE_POOL_SHARE 4
+#define PAGE_POOL_MIN_SIZE (4 * PAGE_BLOCK_SIZE)
+#define PAGE_POOL_MAX_SIZE (128 * PAGE_BLOCK_SIZE)
+#define PAGE_COUNT_MAX (PAGE_POOL_MAX_SIZE / PAGE_SIZE)
+// Set in page_state for the first page of a free buddy block
+#define PAGE_FREE 0x80
+
+// End of the kernel image (from linker.ld); free RAM starts here
+extern "C" unsigned char __kernel_end[];
+
+// Physical RAM
+static unsigned int ram_start = 0;
+static unsigned int ram_size = 0;
+// Heap memory, from the end of the page pool up to heap_limit bytes
+static unsigned char* heap = NULL;
+static unsigned int heap_size = 0;
+static unsigned int heap_limit = 0;
 // First memory block (head of the linked list)
 static MemoryBlock* first_block = NULL;
+// Last memory block, which heap_grow extends
+static MemoryBlock* last_block = NULL;
+
+// Segregated free lists, one per size class
+static MemoryBlock* free_lists[SIZE_CLASS_COUNT];
+// Bit i is set when free_lists[i] is non-empty
+static unsigned int free_class_map = 0;
+// Number of free blocks in each class
+static unsigned int class_free_blocks[SIZE_CLASS_COUNT];
+// Fast path counters
+static unsigned int class_hits[SIZE_CLASS_COUNT];
+static unsigned int class_misses[SIZE_CLASS_COUNT];
+
+// Heap counters, kept up to date by every split, merge, alloc and free
+static unsigned int heap_free_bytes = 0;   // Payload bytes in free blocks
+static unsigned int heap_blocks = 0;       // Blocks in the physical list
+static unsigned int heap_free_blocks = 0;  // Blocks in the free lists
+static unsigned int heap_peak_used = 0;
+static unsigned int heap_alloc_count = 0;
+static unsigned int heap_free_count = 0;
+// Every free block is also in a pairing heap ordered by size, so the largest
+// is always at the root
+static MemoryBlock* free_heap_root = NULL;
+
+// Handle table for movable blocks (slot 0 is unused so 0 can mean "no handle")
+static MemoryBlock* handle_blocks[MAX_HANDLES];
+// Stack of unused handle numbers
+static unsigned short handle_free_stack[MAX_HANDLES];
+static unsigned int handle_free_top = 0;
+// Pin count of each handle; compaction leaves pinned blocks where they are
+static unsigned char handle_pins[MAX_HANDLES];
+static unsigned int heap_compactions = 0;
+
+// Boot arena: a used block whose front is bump-allocated into real blocks
+// until memory_boot_finish returns the rest to the heap
+static MemoryBlock* boot_block = NULL;
+static unsigned int boot_reserved = 0;   // Size of the boot arena
+static unsigned int boot_unused = 0;     // Tail returned at the end of boot
+static unsigned int boot_freed = 0;      // Boot objects freed since
+// Free buddy block header, stored in the free pages themselves
+struct FreePage {
+    FreePage* next;
+    FreePage* prev;
+};
+
+// Page memory (aligned to the largest block so every buddy block is naturally aligned)
+static unsigned char* page_pool = NULL;
+static unsigned int page_pool_size = 0;
+static unsigned int page_count = 0;
+// Free lists, one per order
+static FreePage* page_free_lists[PAGE_MAX_ORDER + 1];
+static unsigned int page_free_blocks[PAGE_MAX_ORDER + 1];
+// PAGE_FREE | order on the head page of each free block, 0 everywhere else
+static unsigned char page_state[PAGE_COUNT_MAX];
+// Number of free pages
+static unsigned int pages_free = 0;
+
+#ifdef MEMORY_PROFILE
+// Number of distinct call sites tracked
+#define PROFILE_MAX_SITES 32
+// Number of log2 histogram buckets (bucket 0 counts zero, bucket k counts [2^(k-1), 2^k))
+#define PROFILE_BUCKETS 20
+
+// Allocation statistics for one call site
+struct ProfileSite {
+    void* caller;
+    unsigned int allocs;
+    unsigned int frees;
+    unsigned int live_bytes;
+    unsigned int total_bytes;
+};
+
+static ProfileSite profile_sites[PROFILE_MAX_SITES];
+static unsigned int profile_size_hist[PROFILE_BUCKETS];
+static unsigned int profile_search_hist[PROFILE_BUCKETS];
+static unsigned int profile_latency_hist[PROFILE_BUCKETS];
+static unsigned int profile_failures = 0;
+// Blocks examined by the allocation in progress
+static unsigned int profile_searched = 0;
+
+#define PROFILE_SEARCHED(n) (profile_searched += (n))
+#else
+#define PROFILE_SEARCHED(n)
+#endif
 
 // Convert integer to string
 void int_to_str(unsigned int num, char* str) {
@@ -42,17 +150,367 @@ void int_to_str(unsigned int num, char* str) {
     str[i] = '\0';
 }
 
+// Percentage of part in whole without overflowing 32 bits
+static unsigned int percent(unsigned int part, unsigned int whole) {
+    if (whole == 0) {
+        return 0;
+    }
+    if (part > 0xFFFFFFFFu / 100) {
+        return part / (whole / 100);
+    }
+    return (part * 100) / whole;
+}
+
+// Pairing heap links of a free block, kept in its unused payload
+struct FreeHeapLinks {
+    MemoryBlock* child;
+    MemoryBlock* sibling;
+    MemoryBlock* prev;        // Parent, or the sibling before it
+};
+
+static_assert(sizeof(FreeHeapLinks) <= MIN_ALLOC_SIZE, "heap links must fit in the smallest free block");
+
+static inline FreeHeapLinks* heap_links(MemoryBlock* block) {
+    return reinterpret_cast<FreeHeapLinks*>(reinterpret_cast<unsigned char*>(block) + sizeof(MemoryBlock));
+}
+
+// Join two pairing heaps; the root of the smaller block becomes the first
+// child of the other. Both roots must have no siblings.
+static MemoryBlock* free_heap_meld(MemoryBlock* a, MemoryBlock* b) {
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+    
+    if (b->size > a->size) {
+        MemoryBlock* t = a;
+        a = b;
+        b = t;
+    }
+    FreeHeapLinks* la = heap_links(a);
+    FreeHeapLinks* lb = heap_links(b);
+    lb->prev = a;
+    lb->sibling = la->child;
+    if (la->child) {
+        heap_links(la->child)->prev = b;
+    }
+    la->child = b;
+    return a;
+}
+
+// Turn a list of siblings back into one heap: meld them in pairs left to
+// right, then fold the pairs together right to left
+static MemoryBlock* free_heap_merge_pairs(MemoryBlock* first) {
+    MemoryBlock* pairs = NULL;
+    while (first != NULL) {
+        MemoryBlock* a = first;
+        MemoryBlock* b = heap_links(a)->sibling;
+        first = b ? heap_links(b)->sibling : NULL;
+        
+        heap_links(a)->sibling = NULL;
+        heap_links(a)->prev = NULL;
+        if (b) {
+            heap_links(b)->sibling = NULL;
+            heap_links(b)->prev = NULL;
+        }
+        MemoryBlock* pair = free_heap_meld(a, b);
+        
+        // Stack the pairs so the second pass sees them in reverse
+        heap_links(pair)->sibling = pairs;
+        pairs = pair;
+    }
+    
+    MemoryBlock* root = NULL;
+    while (pairs != NULL) {
+        MemoryBlock* next = heap_links(pairs)->sibling;
+        heap_links(pairs)->sibling = NULL;
+        root = free_heap_meld(root, pairs);
+        pairs = next;
+    }
+    return root;
+}
+
+// Take any block out of the size heap
+static void free_heap_remove(MemoryBlock* block) {
+    FreeHeapLinks* links = heap_links(block);
+    MemoryBlock* children = free_heap_merge_pairs(links->child);
+    
+    if (block == free_heap_root) {
+        free_heap_root = children;
+        return;
+    }
+    
+    // Unlink from the parent or the sibling before it
+    FreeHeapLinks* prev = heap_links(links->prev);
+    if (prev->child == block) {
+        prev->child = links->sibling;
+    } else {
+        prev->sibling = links->sibling;
+    }
+    if (links->sibling) {
+        heap_links(links->sibling)->prev = links->prev;
+    }
+    free_heap_root = free_heap_meld(free_heap_root, children);
+}
+
+// Get the size class of a block or request (floor of log2, starting at 16 bytes)
+static unsigned int size_class(unsigned int size) {
+    unsigned int cls = 0;
+    size >>= 5;
+    while (size && cls < SIZE_CLASS_COUNT - 1) {
+        size >>= 1;
+        cls++;
+    }
+    return cls;
+}
+
+// Add a free block to the front of its class list
+static void free_list_insert(MemoryBlock* block) {
+    unsigned int cls = size_class(block->size);
+    
+    block->prev_free = NULL;
+    block->next_free = free_lists[cls];
+    if (free_lists[cls]) {
+        free_lists[cls]->prev_free = block;
+    }
+    free_lists[cls] = block;
+    
+    free_class_map |= 1u << cls;
+    class_free_blocks[cls]++;
+    
+    heap_free_bytes += block->size;
+    heap_free_blocks++;
+    
+    FreeHeapLinks* links = heap_links(block);
+    links->child = NULL;
+    links->sibling = NULL;
+    links->prev = NULL;
+    free_heap_root = free_heap_meld(free_heap_root, block);
+}
+
+// Unlink a free block from its class list
+static void free_list_remove(MemoryBlock* block) {
+    unsigned int cls = size_class(block->size);
+    
+    if (block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        free_lists[cls] = block->next_free;
+    }
+    if (block->next_free) {
+        block->next_free->prev_free = block->prev_free;
+    }
+    
+    if (free_lists[cls] == NULL) {
+        free_class_map &= ~(1u << cls);
+    }
+    class_free_blocks[cls]--;
+    
+    heap_free_bytes -= block->size;
+    heap_free_blocks--;
+    
+    free_heap_remove(block);
+}
+
+// Get the index of the page at an address in the page pool
+static unsigned int page_index(void* addr) {
+    return (reinterpret_cast<unsigned char*>(addr) - page_pool) / PAGE_SIZE;
+}
+
+// Add a free buddy block to the front of its order list
+static void page_list_insert(unsigned int index, unsigned int order) {
+    FreePage* page = reinterpret_cast<FreePage*>(page_pool + index * PAGE_SIZE);
+    
+    page->prev = NULL;
+    page->next = page_free_lists[order];
+    if (page->next) {
+        page->next->prev = page;
+    }
+    page_free_lists[order] = page;
+    
+    page_state[index] = PAGE_FREE | order;
+    page_free_blocks[order]++;
+}
+
+// Unlink a free buddy block from its order list
+static void page_list_remove(unsigned int index, unsigned int order) {
+    FreePage* page = reinterpret_cast<FreePage*>(page_pool + index * PAGE_SIZE);
+    
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        page_free_lists[order] = page->next;
+    }
+    if (page->next) {
+        page->next->prev = page->prev;
+    }
+    
+    page_state[index] = 0;
+    page_free_blocks[order]--;
+}
+
+// Initialize the page allocator with the whole pool as maximum-order blocks
+static void page_init() {
+    for (int i = 0; i <= PAGE_MAX_ORDER; i++) {
+        page_free_lists[i] = NULL;
+        page_free_blocks[i] = 0;
+    }
+    
+    for (unsigned int i = 0; i < page_count; i++) {
+        page_state[i] = 0;
+    }
+    
+    for (unsigned int i = 0; i < page_count; i += 1u << PAGE_MAX_ORDER) {
+        page_list_insert(i, PAGE_MAX_ORDER);
+    }
+    pages_free = page_count;
+}
+
+// Smallest order whose block holds size bytes
+unsigned int page_order(unsigned int size) {
+    unsigned int order = 0;
+    while (((unsigned int)PAGE_SIZE << order) < size && order < PAGE_MAX_ORDER) {
+        order++;
+    }
+    return order;
+}
+
+// Allocate 2^order contiguous, naturally aligned pages
+void* alloc_pages(unsigned int order) {
+    IrqGuard guard;
+    
+    if (order > PAGE_MAX_ORDER) {
+        return NULL;
+    }
+    
+    // Find the smallest order with a free block
+    unsigned int current = order;
+    while (current <= PAGE_MAX_ORDER && page_free_lists[current] == NULL) {
+        current++;
+    }
+    if (current > PAGE_MAX_ORDER) {
+        // Out of pages
+        return NULL;
+    }
+    
+    unsigned int index = page_index(page_free_lists[current]);
+    page_list_remove(index, current);
+    
+    // Split down, returning the upper half of each split to the free lists
+    while (current > order) {
+        current--;
+        page_list_insert(index + (1u << current), current);
+    }
+    
+    pages_free -= 1u << order;
+    
+    return page_pool + index * PAGE_SIZE;
+}
+
+// Free pages obtained from alloc_pages with the same order
+void free_pages(void* addr, unsigned int order) {
+    IrqGuard guard;
+    
+    if (!addr) return;
+    
+    unsigned int index = page_index(addr);
+    pages_free += 1u << order;
+    
+    // Merge with the buddy as long as it is free and the same size
+    while (order < PAGE_MAX_ORDER) {
+        unsigned int buddy = index ^ (1u << order);
+        if (page_state[buddy] != (PAGE_FREE | order)) {
+            break;
+        }
+        
+        page_list_remove(buddy, order);
+        if (buddy < index) {
+            index = buddy;
+        }
+        order++;
+    }
+    
+    page_list_insert(index, order);
+}
+
+// Defined below; memory_init uses it to reserve the boot arena
+static void* heap_alloc_once(unsigned int size);
+
 // Initialize the memory manager
 void memory_init() {
-    // Create initial block covering the entire heap
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        free_lists[i] = NULL;
+        class_free_blocks[i] = 0;
+        class_hits[i] = 0;
+        class_misses[i] = 0;
+    }
+    free_class_map = 0;
+    heap_free_bytes = 0;
+    heap_blocks = 1;
+    heap_free_blocks = 0;
+    heap_peak_used = 0;
+    heap_alloc_count = 0;
+    heap_free_count = 0;
+    free_heap_root = NULL;
+    heap_compactions = 0;
+    
+    // All handles start out unused
+    handle_free_top = 0;
+    for (unsigned int i = MAX_HANDLES - 1; i > 0; i--) {
+        handle_blocks[i] = NULL;
+        handle_pins[i] = 0;
+        handle_free_stack[handle_free_top++] = i;
+    }
+    
+    // Find out how much RAM there is
+    if (!atag_mem(&ram_start, &ram_size)) {
+        ram_start = 0;
+        ram_size = DEFAULT_RAM_SIZE;
+    }
+    
+    // Carve the page pool and then the heap out of the RAM after the kernel
+    unsigned long free_start = reinterpret_cast<unsigned long>(__kernel_end);
+    free_start = (free_start + PAGE_BLOCK_SIZE - 1) & ~(unsigned long)(PAGE_BLOCK_SIZE - 1);
+    page_pool = reinterpret_cast<unsigned char*>(free_start);
+    page_pool_size = (ram_start + ram_size - free_start) / PAGE_POOL_SHARE;
+    page_pool_size &= ~(PAGE_BLOCK_SIZE - 1);
+    if (page_pool_size < PAGE_POOL_MIN_SIZE) {
+        page_pool_size = PAGE_POOL_MIN_SIZE;
+    } else if (page_pool_size > PAGE_POOL_MAX_SIZE) {
+        page_pool_size = PAGE_POOL_MAX_SIZE;
+    }
+    page_count = page_pool_size / PAGE_SIZE;
+    heap = page_pool + page_pool_size;
+    heap_limit = ram_start + ram_size - reinterpret_cast<unsigned long>(heap);
+    heap_size = HEAP_CHUNK_SIZE < heap_limit ? HEAP_CHUNK_SIZE : heap_limit;
+    
+    // Create initial block covering the first heap chunk
     first_block = reinterpret_cast<MemoryBlock*>(heap);
-    first_block->size = HEAP_SIZE - sizeof(MemoryBlock);
+    first_block->size = heap_size - sizeof(MemoryBlock);
     first_block->used = false;
+    first_block->boot = false;
+    first_block->handle = 0;
     first_block->next = NULL;
+    first_block->prev = NULL;
+    last_block = first_block;
+    free_list_insert(first_block);
+    
+    page_init();
+    
+    // Reserve the boot arena at the bottom of the heap
+    boot_unused = 0;
+    boot_freed = 0;
+    void* arena = heap_alloc_once(BOOT_ARENA_SIZE);
+    boot_block = arena ? reinterpret_cast<MemoryBlock*>(
+        reinterpret_cast<unsigned char*>(arena) - sizeof(MemoryBlock)) : NULL;
+    boot_reserved = arena ? boot_block->size + sizeof(MemoryBlock) : 0;
+#ifdef MEMORY_PROFILE
+    if (boot_block) {
+        boot_block->site = PROFILE_MAX_SITES;
+    }
+#endif
 }
 
-// Allocate memory
-void* memory_alloc(unsigned int size) {
+// Round a request up to an allocatable block size
+static unsigned int block_size(unsigned int size) {
     // Ensure minimum allocation size
     if (size < MIN_ALLOC_SIZE) {
         size = MIN_ALLOC_SIZE;
@@ -62,47 +520,390 @@ void* memory_alloc(unsigned int size) {
     if (size % 4 != 0) {
         size += 4 - (size % 4);
     }
+    return size;
+}
+
+// Trim a block to size, returning the tail to the free lists if it is
+// large enough to hold a block of its own
+static void block_split(MemoryBlock* block, unsigned int size) {
+    if (block->size < size + sizeof(MemoryBlock) + MIN_ALLOC_SIZE) {
+        return;
+    }
     
-    // Find suitable free block
-    MemoryBlock* current = first_block;
-    while (current) {
-        if (!current->used && current->size >= size) {
-            // Found a suitable block
-            
-            // Split block if it's significantly larger than needed
-            if (current->size >= size + sizeof(MemoryBlock) + MIN_ALLOC_SIZE) {
-                // Calculate new block position (after allocated memory)
-                unsigned char* new_block_addr = reinterpret_cast<unsigned char*>(current) + 
-                                                sizeof(MemoryBlock) + size;
-                MemoryBlock* new_block = reinterpret_cast<MemoryBlock*>(new_block_addr);
-                
-                // Setup new block
-                new_block->size = current->size - size - sizeof(MemoryBlock);
-                new_block->used = false;
-                new_block->next = current->next;
-                
-                // Update current block
-                current->size = size;
-                current->next = new_block;
+    // Calculate new block position (after allocated memory)
+    unsigned char* new_block_addr = reinterpret_cast<unsigned char*>(block) + 
+                                    sizeof(MemoryBlock) + size;
+    MemoryBlock* new_block = reinterpret_cast<MemoryBlock*>(new_block_addr);
+    
+    // Setup new block
+    new_block->size = block->size - size - sizeof(MemoryBlock);
+    new_block->used = false;
+    new_block->boot = false;
+    new_block->handle = 0;
+    new_block->next = block->next;
+    new_block->prev = block;
+    if (new_block->next) {
+        new_block->next->prev = new_block;
+    } else {
+        last_block = new_block;
+    }
+    
+    // Update current block
+    block->size = size;
+    block->next = new_block;
+    heap_blocks++;
+    
+    if (block->boot) {
+        boot_freed += sizeof(MemoryBlock) + new_block->size;
+    }
+    
+    // A shrinking block may have a free neighbour to merge with
+    MemoryBlock* next = new_block->next;
+    if (next && !next->used) {
+        free_list_remove(next);
+        new_block->size += sizeof(MemoryBlock) + next->size;
+        new_block->next = next->next;
+        if (new_block->next) {
+            new_block->next->prev = new_block;
+        } else {
+            last_block = new_block;
+        }
+        heap_blocks--;
+    }
+    
+    free_list_insert(new_block);
+}
+
+// Find and claim a heap block
+static void* heap_alloc_once(unsigned int size) {
+    size = block_size(size);
+    
+    unsigned int cls = size_class(size);
+    MemoryBlock* current = free_lists[cls];
+    
+    PROFILE_SEARCHED(current ? 1 : 0);
+    if (current && current->size >= size) {
+        // Fast path: the most recently freed block of this class fits
+        class_hits[cls]++;
+    } else {
+        // Any block in a larger class is big enough, so take the smallest such class
+        unsigned int larger = free_class_map & ~((2u << cls) - 1);
+        if (larger) {
+            current = free_lists[__builtin_ctz(larger)];
+            PROFILE_SEARCHED(1);
+        } else {
+            // Last resort: search the rest of our own class
+            while (current && current->size < size) {
+                current = current->next_free;
+                PROFILE_SEARCHED(1);
+            }
+            if (!current) {
+                // No suitable block found
+                class_misses[cls]++;
+                return NULL;
             }
-            
-            // Mark block as used
-            current->used = true;
-            
-            // Return pointer to the memory after the block header
-            return reinterpret_cast<void*>(reinterpret_cast<unsigned char*>(current) + 
-                                           sizeof(MemoryBlock));
         }
-        
-        current = current->next;
+        class_misses[cls]++;
+    }
+    
+    free_list_remove(current);
+    block_split(current, size);
+    
+    // Mark block as used
+    current->used = true;
+    current->boot = false;
+    current->handle = 0;
+    
+    heap_alloc_count++;
+    if (heap_size - heap_free_bytes > heap_peak_used) {
+        heap_peak_used = heap_size - heap_free_bytes;
     }
     
-    // No suitable block found
+    // Return pointer to the memory after the block header
+    return reinterpret_cast<void*>(reinterpret_cast<unsigned char*>(current) + 
+                                   sizeof(MemoryBlock));
+}
+
+// Extend the heap towards the top of RAM by enough chunks to hold size bytes
+static bool heap_grow(unsigned int size) {
+    unsigned int grow = size + sizeof(MemoryBlock);
+    grow = (grow + HEAP_CHUNK_SIZE - 1) & ~(HEAP_CHUNK_SIZE - 1);
+    if (grow > heap_limit - heap_size) {
+        grow = heap_limit - heap_size;
+    }
+    if (grow < sizeof(MemoryBlock) + MIN_ALLOC_SIZE) {
+        // Out of RAM
+        return false;
+    }
+    
+    MemoryBlock* last = last_block;
+    
+    // Append the new memory as a free block, merging with a free last block
+    MemoryBlock* block = reinterpret_cast<MemoryBlock*>(heap + heap_size);
+    block->size = grow - sizeof(MemoryBlock);
+    block->used = false;
+    block->boot = false;
+    block->handle = 0;
+    block->next = NULL;
+    block->prev = last;
+    last->next = block;
+    last_block = block;
+    heap_blocks++;
+    heap_size += grow;
+    
+    if (!last->used) {
+        free_list_remove(last);
+        last->size += sizeof(MemoryBlock) + block->size;
+        last->next = NULL;
+        last_block = last;
+        block = last;
+        heap_blocks--;
+    }
+    free_list_insert(block);
+    
+    return true;
+}
+
+// Bump-allocate a block from the front of the boot arena (NULL once it is full)
+static void* boot_alloc(unsigned int size) {
+    size = block_size(size);
+    if (boot_block->size < size + sizeof(MemoryBlock) + MIN_ALLOC_SIZE) {
+        return NULL;
+    }
+    
+    // The object keeps the arena's header; the arena moves up behind it
+    MemoryBlock* block = boot_block;
+    MemoryBlock* rest = reinterpret_cast<MemoryBlock*>(
+        reinterpret_cast<unsigned char*>(block) + sizeof(MemoryBlock) + size);
+    rest->size = block->size - size - sizeof(MemoryBlock);
+    rest->used = true;
+    rest->boot = false;
+    rest->handle = 0;
+#ifdef MEMORY_PROFILE
+    rest->site = PROFILE_MAX_SITES;
+#endif
+    rest->prev = block;
+    rest->next = block->next;
+    if (rest->next) {
+        rest->next->prev = rest;
+    } else {
+        last_block = rest;
+    }
+    
+    block->size = size;
+    block->next = rest;
+    block->boot = true;
+    boot_block = rest;
+    
+    heap_blocks++;
+    heap_alloc_count++;
+    
+    return reinterpret_cast<unsigned char*>(block) + sizeof(MemoryBlock);
+}
+
+// Allocate a heap block, compacting once if fragmentation is in the way and
+// growing the heap if that is not enough (the profiler wraps this when compiled in)
+static inline void* heap_alloc(unsigned int size) {
+    if (boot_block) {
+        void* ptr = boot_alloc(size);
+        if (ptr) {
+            return ptr;
+        }
+    }
+    
+    void* ptr = heap_alloc_once(size);
+    if (ptr == NULL && heap_free_bytes >= size && memory_compact() > 0) {
+        ptr = heap_alloc_once(size);
+    }
+    if (ptr == NULL && heap_grow(size)) {
+        ptr = heap_alloc_once(size);
+    }
+    return ptr;
+}
+
+#ifdef MEMORY_PROFILE
+// Get the histogram bucket for a value
+static unsigned int profile_bucket(unsigned int value) {
+    unsigned int bucket = 0;
+    while (value && bucket < PROFILE_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Find or claim the table entry for a call site (NULL once the table is full)
+static ProfileSite* profile_site(void* caller) {
+    unsigned int start = (reinterpret_cast<unsigned long>(caller) >> 2) % PROFILE_MAX_SITES;
+    for (unsigned int i = 0; i < PROFILE_MAX_SITES; i++) {
+        ProfileSite* site = &profile_sites[(start + i) % PROFILE_MAX_SITES];
+        if (site->caller == caller) {
+            return site;
+        }
+        if (site->caller == NULL) {
+            site->caller = caller;
+            return site;
+        }
+    }
     return NULL;
 }
 
+// Allocate and record the caller, request size, search length and latency
+static void* profile_alloc(unsigned int size, void* caller) {
+    profile_searched = 0;
+    unsigned int start = timer_read();
+    void* ptr = heap_alloc(size);
+    unsigned int ticks = timer_read() - start;
+    
+    profile_size_hist[profile_bucket(size)]++;
+    profile_search_hist[profile_bucket(profile_searched)]++;
+    profile_latency_hist[profile_bucket(timer_ticks_to_ns(ticks))]++;
+    
+    if (!ptr) {
+        profile_failures++;
+        return NULL;
+    }
+    
+    MemoryBlock* block = reinterpret_cast<MemoryBlock*>(
+        reinterpret_cast<unsigned char*>(ptr) - sizeof(MemoryBlock));
+    ProfileSite* site = profile_site(caller);
+    block->site = site ? site - profile_sites : PROFILE_MAX_SITES;
+    if (site) {
+        site->allocs++;
+        site->live_bytes += block->size;
+        site->total_bytes += block->size;
+    }
+    
+    return ptr;
+}
+
+// Charge a free back to the site that allocated the block
+static void profile_free(MemoryBlock* block) {
+    if (block->site < PROFILE_MAX_SITES) {
+        profile_sites[block->site].frees++;
+        profile_sites[block->site].live_bytes -= block->size;
+    }
+}
+
+// Charge an in-place resize to the site that allocated the block
+static void profile_resize(MemoryBlock* block, unsigned int old_size) {
+    if (block->site < PROFILE_MAX_SITES) {
+        profile_sites[block->site].live_bytes += block->size - old_size;
+        if (block->size > old_size) {
+            profile_sites[block->site].total_bytes += block->size - old_size;
+        }
+    }
+}
+#endif
+
+// Allocate memory
+void* memory_alloc(unsigned int size) {
+    IrqGuard guard;
+    
+#ifdef MEMORY_PROFILE
+    return profile_alloc(size, __builtin_return_address(0));
+#else
+    return heap_alloc(size);
+#endif
+}
+
+// Allocate memory whose address is a multiple of align (a power of two).
+// The slack in front of the aligned address is returned to the heap as a
+// free block of its own, and the tail is trimmed as usual.
+void* memory_alloc_aligned(unsigned int size, unsigned int align) {
+    IrqGuard guard;
+    
+    if (align & (align - 1)) {
+        return NULL;
+    }
+    if (align <= 4) {
+        // Every block is already word aligned
+#ifdef MEMORY_PROFILE
+        return profile_alloc(size, __builtin_return_address(0));
+#else
+        return heap_alloc(size);
+#endif
+    }
+    
+    // Leading slack is either zero or big enough to become a free block
+    size = block_size(size);
+    unsigned int min_lead = sizeof(MemoryBlock) + MIN_ALLOC_SIZE;
+    unsigned int padded = size + align + min_lead;
+#ifdef MEMORY_PROFILE
+    void* ptr = profile_alloc(padded, __builtin_return_address(0));
+#else
+    void* ptr = heap_alloc(padded);
+#endif
+    if (!ptr) {
+        return NULL;
+    }
+    
+    MemoryBlock* block = reinterpret_cast<MemoryBlock*>(
+        reinterpret_cast<unsigned char*>(ptr) - sizeof(MemoryBlock));
+    unsigned long addr = reinterpret_cast<unsigned long>(ptr);
+    unsigned long aligned = (addr + align - 1) & ~(unsigned long)(align - 1);
+    while (aligned != addr && aligned - addr < min_lead) {
+        aligned += align;
+    }
+    
+    if (aligned != addr) {
+        unsigned int lead = aligned - addr;
+        
+        // Put a new header just below the aligned address
+        MemoryBlock* aligned_block = reinterpret_cast<MemoryBlock*>(aligned - sizeof(MemoryBlock));
+        aligned_block->size = block->size - lead;
+        aligned_block->used = true;
+        aligned_block->boot = block->boot;
+        aligned_block->handle = 0;
+#ifdef MEMORY_PROFILE
+        aligned_block->site = block->site;
+#endif
+        aligned_block->prev = block;
+        aligned_block->next = block->next;
+        if (aligned_block->next) {
+            aligned_block->next->prev = aligned_block;
+        } else {
+            last_block = aligned_block;
+        }
+        block->size = lead - sizeof(MemoryBlock);
+        block->next = aligned_block;
+        block->used = false;
+        heap_blocks++;
+        if (block->boot) {
+            boot_freed += lead;
+            block->boot = false;
+        }
+        
+        // Free the leading block, merging it with a free block in front
+        MemoryBlock* prev = block->prev;
+        if (prev && !prev->used) {
+            free_list_remove(prev);
+            prev->size += sizeof(MemoryBlock) + block->size;
+            prev->next = aligned_block;
+            aligned_block->prev = prev;
+            block = prev;
+            heap_blocks--;
+        }
+        free_list_insert(block);
+        
+        block = aligned_block;
+    }
+    
+#ifdef MEMORY_PROFILE
+    unsigned int old_size = block->size;
+    block_split(block, size);
+    profile_resize(block, old_size + (aligned - addr));
+#else
+    block_split(block, size);
+#endif
+    
+    return reinterpret_cast<void*>(aligned);
+}
+
 // Free allocated memory
 void memory_free(void* ptr) {
+    IrqGuard guard;
+    
     if (!ptr) return;
     
     // Get block header from pointer
@@ -110,57 +911,370 @@ void memory_free(void* ptr) {
         reinterpret_cast<unsigned char*>(ptr) - sizeof(MemoryBlock)
     );
     
+#ifdef MEMORY_PROFILE
+    profile_free(block);
+#endif
+    
+    // Count boot objects coming back to the heap
+    if (block->boot) {
+        boot_freed += sizeof(MemoryBlock) + block->size;
+        block->boot = false;
+    }
+    
+    // Release the handle of a movable block
+    if (block->handle) {
+        handle_blocks[block->handle] = NULL;
+        handle_pins[block->handle] = 0;
+        handle_free_stack[handle_free_top++] = block->handle;
+        block->handle = 0;
+    }
+    
     // Mark block as free
     block->used = false;
+    heap_free_count++;
     
     // Coalesce with next block if it's free
-    while (block->next && !block->next->used) {
-        // Merge blocks
-        block->size += sizeof(MemoryBlock) + block->next->size;
-        block->next = block->next->next;
+    MemoryBlock* next = block->next;
+    if (next && !next->used) {
+        free_list_remove(next);
+        block->size += sizeof(MemoryBlock) + next->size;
+        block->next = next->next;
+        if (block->next) {
+            block->next->prev = block;
+        } else {
+            last_block = block;
+        }
+        heap_blocks--;
     }
     
     // Coalesce with previous block if it's free
-    MemoryBlock* prev = first_block;
-    while (prev && prev->next != block) {
-        prev = prev->next;
-    }
-    
+    MemoryBlock* prev = block->prev;
     if (prev && !prev->used) {
-        // Merge blocks
+        free_list_remove(prev);
         prev->size += sizeof(MemoryBlock) + block->size;
         prev->next = block->next;
+        if (prev->next) {
+            prev->next->prev = prev;
+        } else {
+            last_block = prev;
+        }
+        block = prev;
+        heap_blocks--;
     }
+    
+    free_list_insert(block);
 }
 
-// Get memory statistics
-MemoryStats memory_get_stats() {
-    MemoryStats stats;
-    stats.total_memory = HEAP_SIZE;
-    stats.used_memory = 0;
-    stats.free_memory = 0;
-    stats.block_count = 0;
-    stats.used_blocks = 0;
-    stats.free_blocks = 0;
+// Resize an allocation. Grows in place by absorbing a free next block,
+// shrinks in place by splitting, and only moves the data when it must.
+// A block that moves is only word aligned, whatever it was allocated with.
+void* memory_realloc(void* ptr, unsigned int size) {
+    IrqGuard guard;
     
-    MemoryBlock* current = first_block;
-    while (current) {
-        stats.block_count++;
+    if (!ptr) {
+#ifdef MEMORY_PROFILE
+        return profile_alloc(size, __builtin_return_address(0));
+#else
+        return heap_alloc(size);
+#endif
+    }
+    if (size == 0) {
+        memory_free(ptr);
+        return NULL;
+    }
+    
+    MemoryBlock* block = reinterpret_cast<MemoryBlock*>(
+        reinterpret_cast<unsigned char*>(ptr) - sizeof(MemoryBlock));
+    unsigned int old_size = block->size;
+    size = block_size(size);
+    
+    // Grow into the next block if it is free and big enough
+    MemoryBlock* next = block->next;
+    if (size > block->size && next && !next->used &&
+        block->size + sizeof(MemoryBlock) + next->size >= size) {
+        free_list_remove(next);
+        block->size += sizeof(MemoryBlock) + next->size;
+        block->next = next->next;
+        if (block->next) {
+            block->next->prev = block;
+        } else {
+            last_block = block;
+        }
+        heap_blocks--;
         
-        if (current->used) {
-            stats.used_memory += current->size;
-            stats.used_blocks++;
+        // No longer a boot object: freeing it would count heap memory as boot memory
+        block->boot = false;
+    }
+    
+    if (size <= block->size) {
+        block_split(block, size);
+#ifdef MEMORY_PROFILE
+        profile_resize(block, old_size);
+#endif
+        if (heap_size - heap_free_bytes > heap_peak_used) {
+            heap_peak_used = heap_size - heap_free_bytes;
+        }
+        return ptr;
+    }
+    
+    // Move to a new block. The allocation may compact the heap and move a
+    // movable block, so look it up again through its handle afterwards.
+    unsigned short handle = block->handle;
+#ifdef MEMORY_PROFILE
+    void* new_ptr = profile_alloc(size, __builtin_return_address(0));
+#else
+    void* new_ptr = heap_alloc(size);
+#endif
+    if (!new_ptr) {
+        return NULL;
+    }
+    if (handle) {
+        block = handle_blocks[handle];
+        ptr = reinterpret_cast<unsigned char*>(block) + sizeof(MemoryBlock);
+    }
+    
+    dma_memcpy(new_ptr, ptr, old_size);
+    
+    // Hand the handle over to the new block before freeing the old one
+    if (handle) {
+        MemoryBlock* new_block = reinterpret_cast<MemoryBlock*>(
+            reinterpret_cast<unsigned char*>(new_ptr) - sizeof(MemoryBlock));
+        new_block->handle = handle;
+        handle_blocks[handle] = new_block;
+        block->handle = 0;
+    }
+    memory_free(ptr);
+    
+    return new_ptr;
+}
+
+// End of boot: give the unused part of the boot arena back to the heap.
+// Objects allocated from it are ordinary blocks and are freed as usual.
+void memory_boot_finish() {
+    IrqGuard guard;
+    
+    if (!boot_block) return;
+    
+    MemoryBlock* rest = boot_block;
+    boot_block = NULL;
+    boot_unused = sizeof(MemoryBlock) + rest->size;
+    memory_free(reinterpret_cast<unsigned char*>(rest) + sizeof(MemoryBlock));
+}
+
+// Allocate a movable block
+MemHandle memory_handle_alloc(unsigned int size) {
+    IrqGuard guard;
+    
+    if (handle_free_top == 0) {
+        // Out of handles
+        return 0;
+    }
+    
+    void* ptr = memory_alloc(size);
+    if (ptr == NULL) {
+        return 0;
+    }
+    
+    MemHandle handle = handle_free_stack[--handle_free_top];
+    MemoryBlock* block = reinterpret_cast<MemoryBlock*>(
+        reinterpret_cast<unsigned char*>(ptr) - sizeof(MemoryBlock));
+    block->handle = handle;
+    handle_blocks[handle] = block;
+    
+    return handle;
+}
+
+// Free a movable block and its handle
+void memory_handle_free(MemHandle handle) {
+    IrqGuard guard;
+    
+    if (handle == 0 || handle >= MAX_HANDLES || handle_blocks[handle] == NULL) {
+        return;
+    }
+    
+    // memory_free releases the handle along with the block
+    memory_free(memory_handle_ptr(handle));
+}
+
+// Resize a movable block, keeping its handle (fails while it is pinned)
+bool memory_handle_realloc(MemHandle handle, unsigned int size) {
+    IrqGuard guard;
+    
+    if (handle == 0 || handle >= MAX_HANDLES || handle_blocks[handle] == NULL || size == 0) {
+        return false;
+    }
+    if (handle_pins[handle] != 0) {
+        return false;
+    }
+    return memory_realloc(memory_handle_ptr(handle), size) != NULL;
+}
+
+// Get the current address of a movable block
+void* memory_handle_ptr(MemHandle handle) {
+    if (handle == 0 || handle >= MAX_HANDLES || handle_blocks[handle] == NULL) {
+        return NULL;
+    }
+    return reinterpret_cast<unsigned char*>(handle_blocks[handle]) + sizeof(MemoryBlock);
+}
+
+// Keep a movable block in place until the matching memory_handle_unpin, so
+// the pointer stays valid across allocations and preemption. Pins nest.
+void* memory_handle_pin(MemHandle handle) {
+    IrqGuard guard;
+    
+    void* ptr = memory_handle_ptr(handle);
+    if (ptr != NULL) {
+        handle_pins[handle]++;
+    }
+    return ptr;
+}
+
+// Let compaction move a pinned block again
+void memory_handle_unpin(MemHandle handle) {
+    IrqGuard guard;
+    
+    if (memory_handle_ptr(handle) != NULL && handle_pins[handle] != 0) {
+        handle_pins[handle]--;
+    }
+}
+
+// Get the usable size of a movable block
+unsigned int memory_handle_size(MemHandle handle) {
+    if (handle == 0 || handle >= MAX_HANDLES || handle_blocks[handle] == NULL) {
+        return 0;
+    }
+    return handle_blocks[handle]->size;
+}
+
+// Slide movable blocks down over the free space in front of them so free
+// space collects into larger blocks. Returns the number of blocks moved.
+unsigned int memory_compact() {
+    IrqGuard guard;
+    
+    unsigned int moved = 0;
+    
+    MemoryBlock* block = first_block;
+    while (block) {
+        MemoryBlock* mover = block->next;
+        if (block->used || !mover || !mover->used || mover->handle == 0 || handle_pins[mover->handle] != 0) {
+            block = block->next;
+            continue;
+        }
+        
+        // block is free and mover is a movable block right after it
+        unsigned int gap_size = block->size;
+        MemoryBlock* before = block->prev;
+        MemoryBlock* after = mover->next;
+        free_list_remove(block);
+        
+        // Copy header and payload down (the ranges may overlap)
+        memmove(block, mover, sizeof(MemoryBlock) + mover->size);
+        
+        MemoryBlock* moved_block = block;
+        moved_block->prev = before;
+        if (before) {
+            before->next = moved_block;
         } else {
-            stats.free_memory += current->size;
-            stats.free_blocks++;
+            first_block = moved_block;
         }
+        handle_blocks[moved_block->handle] = moved_block;
         
-        current = current->next;
+        // The free space now sits after the moved block
+        MemoryBlock* gap = reinterpret_cast<MemoryBlock*>(
+            reinterpret_cast<unsigned char*>(moved_block) + sizeof(MemoryBlock) + moved_block->size);
+        gap->size = gap_size;
+        gap->used = false;
+        gap->boot = false;
+        gap->handle = 0;
+        gap->prev = moved_block;
+        gap->next = after;
+        moved_block->next = gap;
+        if (after) {
+            after->prev = gap;
+        } else {
+            last_block = gap;
+        }
+        
+        // Merge with the following free block, if any
+        if (after && !after->used) {
+            free_list_remove(after);
+            gap->size += sizeof(MemoryBlock) + after->size;
+            gap->next = after->next;
+            if (gap->next) {
+                gap->next->prev = gap;
+            } else {
+                last_block = gap;
+            }
+            heap_blocks--;
+        }
+        
+        free_list_insert(gap);
+        moved++;
+        
+        // Keep sliding blocks down into the same gap
+        block = gap;
+    }
+    
+    heap_compactions++;
+    return moved;
+}
+
+// Walk the physical block list and return the number of blocks
+// (0 if a back link is broken)
+unsigned int memory_walk() {
+    unsigned int count = 0;
+    MemoryBlock* prev = NULL;
+    for (MemoryBlock* block = first_block; block; block = block->next) {
+        if (block->prev != prev) {
+            return 0;
+        }
+        prev = block;
+        count++;
     }
+    return count;
+}
+
+// Get memory statistics
+MemoryStats memory_get_stats() {
+    IrqGuard guard;
+    
+    MemoryStats stats;
+    stats.ram_size = ram_size;
+    stats.heap_limit = heap_limit;
+    stats.total_memory = heap_size;
     
-    // Account for memory used by block headers
-    unsigned int header_size = stats.block_count * sizeof(MemoryBlock);
-    stats.used_memory += header_size;
+    // Headers of every block count as used memory
+    stats.used_memory = heap_size - heap_free_bytes;
+    stats.free_memory = heap_free_bytes;
+    stats.block_count = heap_blocks;
+    stats.used_blocks = heap_blocks - heap_free_blocks;
+    stats.free_blocks = heap_free_blocks;
+    
+    stats.peak_used = heap_peak_used;
+    stats.alloc_count = heap_alloc_count;
+    stats.free_count = heap_free_count;
+    stats.largest_free = free_heap_root ? free_heap_root->size : 0;
+    stats.fragmentation = 100 - percent(stats.largest_free, heap_free_bytes);
+    if (heap_free_bytes == 0) {
+        stats.fragmentation = 0;
+    }
+    stats.movable_blocks = MAX_HANDLES - 1 - handle_free_top;
+    stats.compactions = heap_compactions;
+    stats.boot_reserved = boot_reserved;
+    stats.boot_unused = boot_unused;
+    stats.boot_freed = boot_freed;
+    
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        stats.class_free_blocks[i] = class_free_blocks[i];
+        stats.class_hits[i] = class_hits[i];
+        stats.class_misses[i] = class_misses[i];
+    }
+    
+    stats.pages_total = page_count;
+    stats.pages_free = pages_free;
+    for (int i = 0; i <= PAGE_MAX_ORDER; i++) {
+        stats.page_free_blocks[i] = page_free_blocks[i];
+    }
     
     return stats;
 }
@@ -178,12 +1292,21 @@ void memory_dump() {
     uart_puts(buf);
     uart_puts(" bytes\n");
     
+    // Room left to grow
+    uart_puts("  Heap limit:    ");
+    int_to_str(stats.heap_limit, buf);
+    uart_puts(buf);
+    uart_puts(" bytes (");
+    int_to_str(stats.ram_size / 1024, buf);
+    uart_puts(buf);
+    uart_puts(" KB RAM)\n");
+    
     // Used memory
     uart_puts("  Used memory:   ");
     int_to_str(stats.used_memory, buf);
     uart_puts(buf);
     uart_puts(" bytes (");
-    int_to_str((stats.used_memory * 100) / stats.total_memory, buf);
+    int_to_str(percent(stats.used_memory, stats.total_memory), buf);
     uart_puts(buf);
     uart_puts("%)\n");
     
@@ -192,7 +1315,7 @@ void memory_dump() {
     int_to_str(stats.free_memory, buf);
     uart_puts(buf);
     uart_puts(" bytes (");
-    int_to_str((stats.free_memory * 100) / stats.total_memory, buf);
+    int_to_str(percent(stats.free_memory, stats.total_memory), buf);
     uart_puts(buf);
     uart_puts("%)\n");
     
@@ -208,6 +1331,109 @@ void memory_dump() {
     uart_puts(buf);
     uart_puts(" free)\n");
     
+    // Peak usage and activity
+    uart_puts("  Peak used:     ");
+    int_to_str(stats.peak_used, buf);
+    uart_puts(buf);
+    uart_puts(" bytes\n");
+    
+    uart_puts("  Largest free:  ");
+    int_to_str(stats.largest_free, buf);
+    uart_puts(buf);
+    uart_puts(" bytes\n");
+    
+    uart_puts("  Allocations:   ");
+    int_to_str(stats.alloc_count, buf);
+    uart_puts(buf);
+    uart_puts(" (");
+    int_to_str(stats.free_count, buf);
+    uart_puts(buf);
+    uart_puts(" freed)\n");
+    
+    uart_puts("  Fragmentation: ");
+    int_to_str(stats.fragmentation, buf);
+    uart_puts(buf);
+    uart_puts("% (");
+    int_to_str(stats.movable_blocks, buf);
+    uart_puts(buf);
+    uart_puts(" movable blocks, ");
+    int_to_str(stats.compactions, buf);
+    uart_puts(buf);
+    uart_puts(" compactions)\n");
+    
+    // Boot arena reclaimed by the heap
+    uart_puts("  Boot arena:    ");
+    int_to_str(stats.boot_unused + stats.boot_freed, buf);
+    uart_puts(buf);
+    uart_puts(" of ");
+    int_to_str(stats.boot_reserved, buf);
+    uart_puts(buf);
+    uart_puts(" bytes reclaimed (");
+    int_to_str(stats.boot_unused, buf);
+    uart_puts(buf);
+    uart_puts(" unused, ");
+    int_to_str(stats.boot_freed, buf);
+    uart_puts(buf);
+    uart_puts(" freed)\n");
+    
+    // Size class front-end
+    uart_puts("\nSize Classes:\n");
+    uart_puts("  CLASS     FREE  HITS      MISSES\n");
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        if (stats.class_free_blocks[i] == 0 && stats.class_hits[i] == 0 &&
+            stats.class_misses[i] == 0) {
+            continue;
+        }
+        
+        // Class lower bound in bytes (or KB once it gets large)
+        unsigned int class_size = MIN_ALLOC_SIZE << i;
+        uart_puts("  ");
+        int_to_str(class_size >= 1024 ? class_size / 1024 : class_size, buf);
+        uart_puts(buf);
+        int width = strlen(buf);
+        if (class_size >= 1024) {
+            uart_putc('K');
+            width++;
+        }
+        if (i == SIZE_CLASS_COUNT - 1) {
+            uart_putc('+');
+            width++;
+        }
+        for (int pad = width; pad < 10; pad++) uart_putc(' ');
+        
+        int_to_str(stats.class_free_blocks[i], buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 6; pad++) uart_putc(' ');
+        
+        int_to_str(stats.class_hits[i], buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 10; pad++) uart_putc(' ');
+        
+        int_to_str(stats.class_misses[i], buf);
+        uart_puts(buf);
+        uart_puts("\n");
+    }
+    
+    // Page allocator
+    uart_puts("\nPage Allocator:\n");
+    uart_puts("  Free pages:    ");
+    int_to_str(stats.pages_free, buf);
+    uart_puts(buf);
+    uart_puts(" / ");
+    int_to_str(stats.pages_total, buf);
+    uart_puts(buf);
+    uart_puts(" (4 KB each)\n");
+    uart_puts("  Free by order:");
+    for (int i = 0; i <= PAGE_MAX_ORDER; i++) {
+        uart_puts(" ");
+        int_to_str(i, buf);
+        uart_puts(buf);
+        uart_puts(":");
+        int_to_str(stats.page_free_blocks[i], buf);
+        uart_puts(buf);
+    }
+    uart_puts("\n");
+    
     // Memory map visualization
     uart_puts("\nMemory Map:\n");
     uart_puts("[");
@@ -220,12 +1446,12 @@ void memory_dump() {
         // Calculate block's position in the map
         unsigned int block_size = current->size + sizeof(MemoryBlock);
         unsigned int block_end = block_pos + block_size;
-        unsigned int display_width = (block_size * map_width) / HEAP_SIZE;
+        unsigned int display_width = block_size / (heap_size / map_width);
         if (display_width < 1) display_width = 1;
         
         // Display block
         for (unsigned int i = 0; i < display_width; i++) {
-            uart_putc(current->used ? '#' : '.');
+            uart_putc(current->used ? (current->handle ? 'm' : '#') : '.');
         }
         
         block_pos = block_end;
@@ -233,5 +1459,180 @@ void memory_dump() {
     }
     
     uart_puts("]\n");
-    uart_puts("Legend: # = Used block, . = Free block\n");
-} 
\ No newline at end of file
+    uart_puts("Legend: # = Used block, m = Movable block, . = Free block\n");
+}
+
+// Time memory_free against the old linear predecessor search
+void memory_benchmark() {
+    const unsigned int live_counts[] = { 10, 100, 1000 };
+    const unsigned int block_size = 32;
+    char buf[16];
+    
+    uart_puts("Heap free() latency (average per call):\n");
+    uart_puts("  LIVE    LINEAR PREV SEARCH   BOUNDARY TAG FREE\n");
+    
+    for (unsigned int n = 0; n < sizeof(live_counts) / sizeof(live_counts[0]); n++) {
+        unsigned int live = live_counts[n];
+        void** blocks = (void**)memory_alloc(live * sizeof(void*));
+        if (!blocks) {
+            uart_puts("  Out of memory\n");
+            return;
+        }
+        
+        unsigned int count = 0;
+        while (count < live) {
+            blocks[count] = memory_alloc(block_size);
+            if (!blocks[count]) break;
+            count++;
+        }
+        
+        // Before: find each block's predecessor by walking from the head
+        unsigned int linear_ticks = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            MemoryBlock* block = reinterpret_cast<MemoryBlock*>(
+                reinterpret_cast<unsigned char*>(blocks[i]) - sizeof(MemoryBlock));
+            unsigned int start = timer_read();
+            volatile MemoryBlock* prev = first_block;
+            while (prev && prev->next != block) {
+                prev = prev->next;
+            }
+            linear_ticks += timer_read() - start;
+        }
+        
+        // After: free each block through the boundary tags, keeping the live count fixed
+        unsigned int free_ticks = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            unsigned int start = timer_read();
+            memory_free(blocks[i]);
+            free_ticks += timer_read() - start;
+            blocks[i] = memory_alloc(block_size);
+        }
+        
+        for (unsigned int i = 0; i < count; i++) {
+            memory_free(blocks[i]);
+        }
+        memory_free(blocks);
+        
+        // Report
+        uart_puts("  ");
+        int_to_str(count, buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 8; pad++) uart_putc(' ');
+        
+        int_to_str(count ? timer_ticks_to_ns(linear_ticks) / count : 0, buf);
+        uart_puts(buf);
+        uart_puts(" ns");
+        for (int pad = strlen(buf) + 3; pad < 21; pad++) uart_putc(' ');
+        
+        int_to_str(count ? timer_ticks_to_ns(free_ticks) / count : 0, buf);
+        uart_puts(buf);
+        uart_puts(" ns\n");
+    }
+}
+
+#ifdef MEMORY_PROFILE
+// Convert integer to a fixed-width hex string
+static void hex_to_str(unsigned long num, char* str) {
+    const char* digits = "0123456789abcdef";
+    str[0] = '0';
+    str[1] = 'x';
+    for (int i = 0; i < 8; i++) {
+        str[2 + i] = digits[(num >> ((7 - i) * 4)) & 0xF];
+    }
+    str[10] = '\0';
+}
+
+// Print one log2 histogram, skipping empty buckets
+static void profile_print_histogram(const char* title, unsigned int* hist) {
+    char buf[16];
+    unsigned int total = 0;
+    for (int i = 0; i < PROFILE_BUCKETS; i++) {
+        total += hist[i];
+    }
+    
+    uart_puts(title);
+    for (int i = 0; i < PROFILE_BUCKETS; i++) {
+        if (hist[i] == 0) continue;
+        
+        // Bucket range
+        uart_puts("  ");
+        int width = 0;
+        if (i == 0) {
+            uart_puts("0");
+            width = 1;
+        } else {
+            int_to_str(1u << (i - 1), buf);
+            uart_puts(buf);
+            width = strlen(buf);
+            if (i == PROFILE_BUCKETS - 1) {
+                uart_puts("+");
+                width++;
+            } else if (i > 1) {
+                uart_puts("-");
+                int_to_str((1u << i) - 1, buf);
+                uart_puts(buf);
+                width += 1 + strlen(buf);
+            }
+        }
+        for (int pad = width; pad < 16; pad++) uart_putc(' ');
+        
+        // Bar scaled to the total
+        int bar = (hist[i] * 30) / total;
+        for (int j = 0; j < 30; j++) {
+            uart_putc(j < bar || (j == 0 && hist[i]) ? '#' : ' ');
+        }
+        uart_puts(" ");
+        int_to_str(hist[i], buf);
+        uart_puts(buf);
+        uart_puts("\n");
+    }
+}
+#endif
+
+// Display the allocation profile
+void memory_profile_dump() {
+#ifdef MEMORY_PROFILE
+    char buf[16];
+    
+    uart_puts("Allocation Profile:\n");
+    uart_puts("  CALLER      ALLOCS  FREES   LIVE BYTES  TOTAL BYTES\n");
+    for (int i = 0; i < PROFILE_MAX_SITES; i++) {
+        ProfileSite* site = &profile_sites[i];
+        if (site->caller == NULL) continue;
+        
+        uart_puts("  ");
+        hex_to_str(reinterpret_cast<unsigned long>(site->caller), buf);
+        uart_puts(buf);
+        uart_puts("  ");
+        
+        int_to_str(site->allocs, buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 8; pad++) uart_putc(' ');
+        
+        int_to_str(site->frees, buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 8; pad++) uart_putc(' ');
+        
+        int_to_str(site->live_bytes, buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 12; pad++) uart_putc(' ');
+        
+        int_to_str(site->total_bytes, buf);
+        uart_puts(buf);
+        uart_puts("\n");
+    }
+    
+    uart_puts("  Failed allocations: ");
+    int_to_str(profile_failures, buf);
+    uart_puts(buf);
+    uart_puts("\n");
+    
+    profile_print_histogram("\nRequest size (bytes):\n", profile_size_hist);
+    profile_print_histogram("\nSearch length (blocks examined):\n", profile_search_hist);
+    profile_print_histogram("\nLatency (ns):\n", profile_latency_hist);
+    
+    uart_puts("\nResolve callers with: arm-none-eabi-addr2line -e kernel.bin <addr>\n");
+#else
+    uart_puts("Allocation profiler not compiled in (build with 'make MEMORY_PROFILE=1')\n");
+#endif
+}
@@ -1,29 +1,98 @@
 #ifndef MEMORY_HPP
 #define MEMORY_HPP
 
+// Number of segregated size classes (class i holds blocks of 16 << i bytes and up)
+#define SIZE_CLASS_COUNT 16
+
+// Page allocator geometry (largest buddy block is PAGE_SIZE << PAGE_MAX_ORDER)
+#define PAGE_SIZE 4096
+#define PAGE_MAX_ORDER 6
+
+// Data cache line size of the ARM926EJ-S
+#define CACHE_LINE_SIZE 32
+
+// Maximum number of movable allocations
+#define MAX_HANDLES 256
+
+// Handle to a movable allocation (0 is never a valid handle)
+typedef unsigned int MemHandle;
+
 // Memory block structure
 struct MemoryBlock {
     unsigned int size;
     bool used;
-    MemoryBlock* next;
+    bool boot;               // Allocated from the boot arena
+    unsigned short handle;   // Owning handle for movable blocks, 0 if pinned
+    MemoryBlock* next;       // Next block in address order
+    MemoryBlock* prev;       // Previous block in address order
+    MemoryBlock* next_free;  // Next free block in the same size class
+    MemoryBlock* prev_free;  // Previous free block in the same size class
+#ifdef MEMORY_PROFILE
+    unsigned int site;       // Profiler call-site index
+#endif
 };
 
 // Memory management functions
 void memory_init();
 void* memory_alloc(unsigned int size);
+void* memory_alloc_aligned(unsigned int size, unsigned int align);
 void memory_free(void* ptr);
+void* memory_realloc(void* ptr, unsigned int size);
 void memory_dump();
+void memory_benchmark();
+void memory_profile_dump();
+void memory_boot_finish();
+unsigned int memory_walk();
+
+// Movable allocations. Pointers from memory_handle_ptr stay valid only
+// until the next allocation, which may compact the heap; memory_handle_pin
+// keeps one valid (and the block unresizable) until memory_handle_unpin.
+MemHandle memory_handle_alloc(unsigned int size);
+void memory_handle_free(MemHandle handle);
+bool memory_handle_realloc(MemHandle handle, unsigned int size);
+void* memory_handle_ptr(MemHandle handle);
+void* memory_handle_pin(MemHandle handle);
+void memory_handle_unpin(MemHandle handle);
+unsigned int memory_handle_size(MemHandle handle);
+unsigned int memory_compact();
+
+// Page allocator functions (binary buddy system)
+void* alloc_pages(unsigned int order);
+void free_pages(void* addr, unsigned int order);
+unsigned int page_order(unsigned int size);
 
 // Memory statistics
 struct MemoryStats {
-    unsigned int total_memory;
+    unsigned int ram_size;
+    unsigned int heap_limit;        // Size the heap can grow to
+    unsigned int total_memory;      // Current heap size
     unsigned int used_memory;
     unsigned int free_memory;
     unsigned int block_count;
     unsigned int used_blocks;
     unsigned int free_blocks;
+    unsigned int peak_used;
+    unsigned int alloc_count;
+    unsigned int free_count;
+    unsigned int largest_free;
+    unsigned int fragmentation;     // Percent of free memory outside the largest free block
+    unsigned int movable_blocks;
+    unsigned int compactions;
+    unsigned int boot_reserved;     // Boot arena size
+    unsigned int boot_unused;       // Unused boot arena returned to the heap
+    unsigned int boot_freed;        // Boot objects freed back to the heap
+
+    // Size class front-end
+    unsigned int class_free_blocks[SIZE_CLASS_COUNT];
+    unsigned int class_hits[SIZE_CLASS_COUNT];    // Served from the request's own class
+    unsigned int class_misses[SIZE_CLASS_COUNT];  // Had to split a block from a larger class
+
+    // Page allocator
+    unsigned int pages_total;
+    unsigned int pages_free;
+    unsigned int page_free_blocks[PAGE_MAX_ORDER + 1];  // Free buddy blocks per order
 };
 
 MemoryStats memory_get_stats();
 
-#endif // MEMORY_HPP 
\ No newline at end of file
+#endif // MEMORY_HPP
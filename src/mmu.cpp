@@ -0,0 +1,250 @@
+#include "mmu.hpp"
+#include "memory.hpp"
+#include "timer.hpp"
+#include "uart.hpp"
+#include "kstring.hpp"
+
+/*
+ * MMU and caches for QEMU/VersatilePB (ARM926EJ-S)
+ * The whole 4 GB address space is identity mapped with 1 MB sections.
+ * RAM is cacheable and bufferable; everything else, including the
+ * peripheral window at 0x10000000 (UART0 at 0x101F1000), is mapped as
+ * uncached, unbuffered device memory.
+ */
+
+// Forward declarations
+void int_to_str(unsigned int num, char* str);
+
+// Number of first-level entries (one per 1 MB section)
+#define MMU_L1_ENTRIES 4096
+
+// First-level section descriptor bits
+#define SECTION_TYPE    0x002         // Section descriptor
+#define SECTION_B       0x004         // Bufferable
+#define SECTION_C       0x008         // Cacheable
+#define SECTION_BIT4    0x010         // Must be set on ARMv5
+#define SECTION_AP_RW   (0x3 << 10)   // Read/write at all privilege levels
+#define SECTION_DOMAIN0 (0x0 << 5)
+
+#define SECTION_NORMAL (SECTION_TYPE | SECTION_BIT4 | SECTION_AP_RW | SECTION_DOMAIN0 | SECTION_C | SECTION_B)
+#define SECTION_DEVICE (SECTION_TYPE | SECTION_BIT4 | SECTION_AP_RW | SECTION_DOMAIN0)
+
+// CP15 control register bits
+#define CTRL_MMU     (1 << 0)
+#define CTRL_DCACHE  (1 << 2)
+#define CTRL_ICACHE  (1 << 12)
+
+// Domain 0 as client: accesses are checked against the AP bits
+#define DOMAIN0_CLIENT 0x1
+
+// First-level translation table (must be 16 KB aligned)
+static unsigned int l1_table[MMU_L1_ENTRIES] __attribute__((aligned(16384)));
+
+// Read the CP15 control register
+static inline unsigned int cp15_read_control() {
+    unsigned int value;
+    asm volatile("mrc p15, 0, %0, c1, c0, 0" : "=r"(value));
+    return value;
+}
+
+// Write the CP15 control register
+static inline void cp15_write_control(unsigned int value) {
+    asm volatile("mcr p15, 0, %0, c1, c0, 0" : : "r"(value) : "memory");
+}
+
+// Wait for buffered writes to reach memory
+static inline void drain_write_buffer() {
+    asm volatile("mcr p15, 0, %0, c7, c10, 4" : : "r"(0) : "memory");
+}
+
+// Build the section table and turn on the MMU and caches.
+// RAM starts at address 0 on VersatilePB.
+void mmu_init(unsigned int ram_size) {
+    unsigned int ram_sections = (ram_size + MMU_SECTION_SIZE - 1) / MMU_SECTION_SIZE;
+    
+    for (unsigned int i = 0; i < MMU_L1_ENTRIES; i++) {
+        unsigned int attributes = i < ram_sections ? SECTION_NORMAL : SECTION_DEVICE;
+        l1_table[i] = (i * MMU_SECTION_SIZE) | attributes;
+    }
+    
+    // Start from clean caches and TLBs
+    asm volatile("mcr p15, 0, %0, c7, c7, 0" : : "r"(0) : "memory");   // Invalidate I and D caches
+    asm volatile("mcr p15, 0, %0, c8, c7, 0" : : "r"(0) : "memory");   // Invalidate TLBs
+    
+    asm volatile("mcr p15, 0, %0, c2, c0, 0" : : "r"(l1_table) : "memory");       // Translation table base
+    asm volatile("mcr p15, 0, %0, c3, c0, 0" : : "r"(DOMAIN0_CLIENT) : "memory"); // Domain access control
+    
+    cp15_write_control(cp15_read_control() | CTRL_MMU | CTRL_DCACHE | CTRL_ICACHE);
+}
+
+// Check whether address translation is on
+bool mmu_enabled() {
+    return (cp15_read_control() & CTRL_MMU) != 0;
+}
+
+// Turn the I and D caches on
+void cache_enable() {
+    asm volatile("mcr p15, 0, %0, c7, c7, 0" : : "r"(0) : "memory");   // Invalidate I and D caches
+    cp15_write_control(cp15_read_control() | CTRL_DCACHE | CTRL_ICACHE);
+}
+
+// Turn the I and D caches off, writing back dirty lines first
+void cache_disable() {
+    dcache_clean_invalidate_all();
+    cp15_write_control(cp15_read_control() & ~(CTRL_DCACHE | CTRL_ICACHE));
+    icache_invalidate_all();
+}
+
+// Check whether the data cache is on
+bool cache_enabled() {
+    return (cp15_read_control() & CTRL_DCACHE) != 0;
+}
+
+// Write every dirty D-cache line back to memory
+void dcache_clean_all() {
+    // The ARM926 "test and clean" operation sets Z once no dirty lines remain
+    asm volatile(
+        "1: mrc p15, 0, APSR_nzcv, c7, c10, 3\n"
+        "   bne 1b\n"
+        : : : "cc", "memory");
+    drain_write_buffer();
+}
+
+// Write back and discard every D-cache line
+void dcache_clean_invalidate_all() {
+    asm volatile(
+        "1: mrc p15, 0, APSR_nzcv, c7, c14, 3\n"
+        "   bne 1b\n"
+        : : : "cc", "memory");
+    drain_write_buffer();
+}
+
+// Write back the lines covering a buffer (before a device reads it)
+void dcache_clean_range(void* addr, unsigned int size) {
+    unsigned long start = reinterpret_cast<unsigned long>(addr) & ~(unsigned long)(CACHE_LINE_SIZE - 1);
+    unsigned long end = reinterpret_cast<unsigned long>(addr) + size;
+    
+    for (unsigned long line = start; line < end; line += CACHE_LINE_SIZE) {
+        asm volatile("mcr p15, 0, %0, c7, c10, 1" : : "r"(line) : "memory");
+    }
+    drain_write_buffer();
+}
+
+// Discard the lines covering a buffer (before the CPU reads what a device wrote).
+// Partial lines at either end are written back first so neighbours survive.
+void dcache_invalidate_range(void* addr, unsigned int size) {
+    unsigned long start = reinterpret_cast<unsigned long>(addr);
+    unsigned long end = start + size;
+    
+    if (start & (CACHE_LINE_SIZE - 1)) {
+        start &= ~(unsigned long)(CACHE_LINE_SIZE - 1);
+        asm volatile("mcr p15, 0, %0, c7, c14, 1" : : "r"(start) : "memory");
+        start += CACHE_LINE_SIZE;
+    }
+    if (end & (CACHE_LINE_SIZE - 1)) {
+        end &= ~(unsigned long)(CACHE_LINE_SIZE - 1);
+        if (end >= start) {
+            asm volatile("mcr p15, 0, %0, c7, c14, 1" : : "r"(end) : "memory");
+        }
+    }
+    
+    for (unsigned long line = start; line < end; line += CACHE_LINE_SIZE) {
+        asm volatile("mcr p15, 0, %0, c7, c6, 1" : : "r"(line) : "memory");
+    }
+}
+
+// Write back and discard the lines covering a buffer
+void dcache_clean_invalidate_range(void* addr, unsigned int size) {
+    unsigned long start = reinterpret_cast<unsigned long>(addr) & ~(unsigned long)(CACHE_LINE_SIZE - 1);
+    unsigned long end = reinterpret_cast<unsigned long>(addr) + size;
+    
+    for (unsigned long line = start; line < end; line += CACHE_LINE_SIZE) {
+        asm volatile("mcr p15, 0, %0, c7, c14, 1" : : "r"(line) : "memory");
+    }
+    drain_write_buffer();
+}
+
+// Discard the whole I-cache (after writing code or vectors)
+void icache_invalidate_all() {
+    asm volatile("mcr p15, 0, %0, c7, c5, 0" : : "r"(0) : "memory");
+}
+
+// Wait for interrupt. The core wakes when IRQ or FIQ is asserted whether or
+// not it is masked in the CPSR, so callers can sleep with IRQs disabled and
+// take the interrupt once they have restored their state.
+void cpu_wait_for_interrupt() {
+    asm volatile("mcr p15, 0, %0, c7, c0, 4" : : "r"(0) : "memory");
+}
+
+// Run one benchmark pass and return the throughput in KB/ms (roughly MB/s)
+static unsigned int bench_pass(int test, unsigned char* src, unsigned char* dst, unsigned int size) {
+    const unsigned int rounds = 16;
+    unsigned int start = timer_read();
+    
+    for (unsigned int r = 0; r < rounds; r++) {
+        if (test == 0) {
+            memset(dst, r, size);
+        } else if (test == 1) {
+            memcpy(dst, src, size);
+        } else {
+            memory_walk();
+        }
+    }
+    
+    unsigned int us = timer_ticks_to_us(timer_read() - start);
+    if (us == 0) {
+        us = 1;
+    }
+    
+    // Heap walks are reported in blocks per ms instead
+    unsigned int amount = test == 2 ? memory_get_stats().block_count * rounds : (size / 1024) * rounds;
+    return (amount * 1000) / us;
+}
+
+// Compare memset, memcpy and heap-walk throughput with caches off and on
+void cache_benchmark() {
+    const unsigned int size = 64 * 1024;
+    const char* names[] = { "memset", "memcpy", "heap walk" };
+    const char* units[] = { "KB/ms", "KB/ms", "blocks/ms" };
+    char buf[16];
+    
+    unsigned char* src = (unsigned char*)memory_alloc_aligned(size, CACHE_LINE_SIZE);
+    unsigned char* dst = (unsigned char*)memory_alloc_aligned(size, CACHE_LINE_SIZE);
+    if (!src || !dst) {
+        uart_puts("Out of memory\n");
+        memory_free(src);
+        memory_free(dst);
+        return;
+    }
+    memset(src, 0x5A, size);
+    
+    bool was_enabled = cache_enabled();
+    
+    uart_puts("Cache benchmark (64 KB buffers, 16 rounds):\n");
+    uart_puts("  TEST        CACHES OFF    CACHES ON\n");
+    for (int test = 0; test < 3; test++) {
+        cache_disable();
+        unsigned int off = bench_pass(test, src, dst, size);
+        cache_enable();
+        unsigned int on = bench_pass(test, src, dst, size);
+        
+        uart_puts("  ");
+        uart_puts(names[test]);
+        for (int pad = strlen(names[test]); pad < 12; pad++) uart_putc(' ');
+        int_to_str(off, buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 14; pad++) uart_putc(' ');
+        int_to_str(on, buf);
+        uart_puts(buf);
+        uart_puts(" ");
+        uart_puts(units[test]);
+        uart_puts("\n");
+    }
+    
+    if (!was_enabled) {
+        cache_disable();
+    }
+    
+    memory_free(src);
+    memory_free(dst);
+}
@@ -0,0 +1,28 @@
+#ifndef MMU_HPP
+#define MMU_HPP
+
+// Size of a first-level section mapping
+#define MMU_SECTION_SIZE (1024 * 1024)
+
+// MMU and cache functions (ARM926EJ-S, CP15)
+void mmu_init(unsigned int ram_size);
+bool mmu_enabled();
+
+void cache_enable();
+void cache_disable();
+bool cache_enabled();
+
+// Cache maintenance. Ranges are widened to whole cache lines.
+void dcache_clean_all();
+void dcache_clean_invalidate_all();
+void dcache_clean_range(void* addr, unsigned int size);
+void dcache_invalidate_range(void* addr, unsigned int size);
+void dcache_clean_invalidate_range(void* addr, unsigned int size);
+void icache_invalidate_all();
+
+// Stop the clock until an interrupt is pending (even a masked one)
+void cpu_wait_for_interrupt();
+
+void cache_benchmark();
+
+#endif // MMU_HPP
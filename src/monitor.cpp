@@ -1,11 +1,10 @@
 #include "monitor.hpp"
 #include "memory.hpp"
 #include "process.hpp"
+#include "slab.hpp"
 #include "uart.hpp"
-
-// Forward declarations
-extern int strcmp(const char* s1, const char* s2);
-extern void* memset(void* s, int c, unsigned int n);
+#include "dma.hpp"
+#include "kstring.hpp"
 
 // Define NULL if not defined
 #ifndef NULL
@@ -15,6 +14,12 @@ extern void* memset(void* s, int c, unsigned int n);
 // Current monitor mode
 static MonitorMode current_mode = MONITOR_OVERVIEW;
 
+// Size of the buffer a screen is drawn into before it is sent
+#define MONITOR_FRAME_SIZE 4096
+
+// Screen buffer, sent to the UART in one DMA transfer
+static char monitor_frame[MONITOR_FRAME_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+
 // Helper function to draw horizontal line
 void monitor_draw_line(char c, int length) {
     for (int i = 0; i < length; i++) {
@@ -23,6 +28,17 @@ void monitor_draw_line(char c, int length) {
     uart_puts("\n");
 }
 
+// Percentage of part in whole without overflowing 32 bits
+unsigned int monitor_percent(unsigned int part, unsigned int whole) {
+    if (whole == 0) {
+        return 0;
+    }
+    if (part > 0xFFFFFFFFu / 100) {
+        return part / (whole / 100);
+    }
+    return (part * 100) / whole;
+}
+
 // Helper function to convert int to string
 void monitor_int_to_str(unsigned int num, char* str) {
     // base case: if it has 0 add terminator directly
@@ -31,7 +47,7 @@ void monitor_int_to_str(unsigned int num, char* str) {
         str[1] = '\0';
         return;
     }
-
+    
     int i = 0;
     char temp[16];
     
@@ -48,6 +64,19 @@ void monitor_int_to_str(unsigned int num, char* str) {
     str[i] = '\0';
 }
 
+// Print the 1, 10 and 60 second load averages (given in hundredths)
+void monitor_draw_load(const unsigned int* load_avg) {
+    char buf[16];
+    for (int i = 0; i < 3; i++) {
+        monitor_int_to_str(load_avg[i] / 100, buf);
+        uart_puts(buf);
+        uart_putc('.');
+        uart_putc('0' + load_avg[i] % 100 / 10);
+        uart_putc('0' + load_avg[i] % 10);
+        uart_puts(i < 2 ? "  " : "  (1 s, 10 s, 60 s)");
+    }
+}
+
 // Draw a bar graph (percentage based)
 void monitor_draw_bar(unsigned int percentage, int width) {
     int filled = (percentage * width) / 100;
@@ -92,7 +121,7 @@ void monitor_show_overview() {
     monitor_draw_line('-', 50);
     
     // Calculate percentage
-    unsigned int mem_percentage = (mem_stats.used_memory * 100) / mem_stats.total_memory;
+    unsigned int mem_percentage = monitor_percent(mem_stats.used_memory, mem_stats.total_memory);
     
     // Draw bar
     uart_puts("  ");
@@ -116,9 +145,11 @@ void monitor_show_overview() {
     uart_puts("\nProcess Usage:\n");
     monitor_draw_line('-', 50);
     
-    // CPU usage
+    // CPU usage over the last second, and load
     uart_puts("  CPU: ");
     monitor_draw_bar(proc_stats.cpu_usage, 30);
+    uart_puts("\n  Load: ");
+    monitor_draw_load(proc_stats.load_avg);
     uart_puts("\n");
     
     // Process counts
@@ -148,7 +179,7 @@ void monitor_show_overview() {
     }
     
     // Commands help
-    uart_puts("\nCommands: mem, proc, help, exit\n");
+    uart_puts("\nCommands: mem, proc, slab, help, exit\n");
 }
 
 // Display detailed memory view
@@ -178,7 +209,7 @@ void monitor_show_memory() {
     monitor_int_to_str(stats.used_memory, buf);
     uart_puts(buf);
     uart_puts(" bytes (");
-    monitor_int_to_str((stats.used_memory * 100) / stats.total_memory, buf);
+    monitor_int_to_str(monitor_percent(stats.used_memory, stats.total_memory), buf);
     uart_puts(buf);
     uart_puts("%)\n");
     
@@ -187,7 +218,7 @@ void monitor_show_memory() {
     monitor_int_to_str(stats.free_memory, buf);
     uart_puts(buf);
     uart_puts(" bytes (");
-    monitor_int_to_str((stats.free_memory * 100) / stats.total_memory, buf);
+    monitor_int_to_str(monitor_percent(stats.free_memory, stats.total_memory), buf);
     uart_puts(buf);
     uart_puts("%)\n");
     
@@ -203,6 +234,65 @@ void monitor_show_memory() {
     uart_puts(buf);
     uart_puts(" free)\n");
     
+    // Peak usage and activity
+    uart_puts("  Peak used:     ");
+    monitor_int_to_str(stats.peak_used, buf);
+    uart_puts(buf);
+    uart_puts(" bytes\n");
+    
+    uart_puts("  Largest free:  ");
+    monitor_int_to_str(stats.largest_free, buf);
+    uart_puts(buf);
+    uart_puts(" bytes\n");
+    
+    uart_puts("  Fragmentation: ");
+    monitor_int_to_str(stats.fragmentation, buf);
+    uart_puts(buf);
+    uart_puts("% (");
+    monitor_int_to_str(stats.compactions, buf);
+    uart_puts(buf);
+    uart_puts(" compactions)\n");
+    
+    uart_puts("  Allocations:   ");
+    monitor_int_to_str(stats.alloc_count, buf);
+    uart_puts(buf);
+    uart_puts(" (");
+    monitor_int_to_str(stats.free_count, buf);
+    uart_puts(buf);
+    uart_puts(" freed)\n");
+    
+    // Page allocator
+    uart_puts("\nPage Allocator:\n");
+    monitor_draw_line('-', 50);
+    
+    unsigned int page_percentage = ((stats.pages_total - stats.pages_free) * 100) / stats.pages_total;
+    uart_puts("  ");
+    monitor_draw_bar(page_percentage, 30);
+    uart_puts("\n");
+    
+    uart_puts("  Free pages:    ");
+    monitor_int_to_str(stats.pages_free, buf);
+    uart_puts(buf);
+    uart_puts(" / ");
+    monitor_int_to_str(stats.pages_total, buf);
+    uart_puts(buf);
+    uart_puts("\n");
+    
+    uart_puts("  ORDER  SIZE     FREE BLOCKS\n");
+    for (int i = 0; i <= PAGE_MAX_ORDER; i++) {
+        uart_puts("  ");
+        monitor_int_to_str(i, buf);
+        uart_puts(buf);
+        uart_puts("      ");
+        monitor_int_to_str((PAGE_SIZE << i) / 1024, buf);
+        uart_puts(buf);
+        uart_puts(" KB");
+        for (int pad = strlen(buf); pad < 6; pad++) uart_putc(' ');
+        monitor_int_to_str(stats.page_free_blocks[i], buf);
+        uart_puts(buf);
+        uart_puts("\n");
+    }
+    
     // Memory map visualization
     uart_puts("\nMemory Map:\n");
     monitor_draw_line('-', 50);
@@ -211,7 +301,7 @@ void monitor_show_memory() {
     memory_dump();
     
     // Commands help
-    uart_puts("\nCommands: overview, proc, help, exit\n");
+    uart_puts("\nCommands: overview, proc, slab, help, exit\n");
 }
 
 // Display detailed process view
@@ -250,19 +340,132 @@ void monitor_show_process() {
     uart_puts("  CPU Usage:  ");
     monitor_int_to_str(stats.cpu_usage, buf);
     uart_puts(buf);
-    uart_puts("%\n");
+    uart_puts("% (last second), ");
+    monitor_int_to_str(stats.cpu_usage_total, buf);
+    uart_puts(buf);
+    uart_puts("% since boot\n");
+    
+    uart_puts("  Load average:  ");
+    monitor_draw_load(stats.load_avg);
+    uart_puts("\n");
+    
+    uart_puts("  Idle residency:  ");
+    monitor_int_to_str(stats.idle_residency, buf);
+    uart_puts(buf);
+    uart_puts("% (last second), ");
+    monitor_int_to_str(stats.idle_residency_total, buf);
+    uart_puts(buf);
+    uart_puts("% since boot\n");
+    
+    uart_puts("  Wakeup latency:  ");
+    monitor_int_to_str(stats.wakeup_latency_ns, buf);
+    uart_puts(buf);
+    uart_puts(" ns avg, ");
+    monitor_int_to_str(stats.wakeup_latency_max_ns, buf);
+    uart_puts(buf);
+    uart_puts(" ns max  Ticks skipped:  ");
+    monitor_int_to_str(stats.idle_ticks_skipped, buf);
+    uart_puts(buf);
+    uart_puts("\n");
+    
+    uart_puts("  Switches:  ");
+    monitor_int_to_str(stats.switch_rate, buf);
+    uart_puts(buf);
+    uart_puts("/s  Voluntary:  ");
+    monitor_int_to_str(stats.voluntary_switches, buf);
+    uart_puts(buf);
+    uart_puts("  Preempted:  ");
+    monitor_int_to_str(stats.involuntary_switches, buf);
+    uart_puts(buf);
+    uart_puts("\n");
+    
+    uart_puts("  Real-time (EDF):  ");
+    monitor_int_to_str(stats.rt_processes, buf);
+    uart_puts(buf);
+    uart_puts("  Reserved:  ");
+    monitor_int_to_str(process_get_rt_utilization() / 10, buf);
+    uart_puts(buf);
+    uart_puts("%  Deadline misses:  ");
+    monitor_int_to_str(stats.deadline_misses, buf);
+    uart_puts(buf);
+    uart_puts("\n");
     
     // Process list
     uart_puts("\nProcess List:\n");
-    monitor_draw_line('-', 64);
-    uart_puts("PID  STATE     PRIORITY  RUNTIME   NAME\n");
-    monitor_draw_line('-', 64);
+    monitor_draw_line('-', 71);
+    uart_puts("PID  STATE     PRIORITY  RUNTIME   VRUNTIME  WAIT      CPU  NAME\n");
+    monitor_draw_line('-', 71);
     
     // Call process dump to show process list
     process_dump();
     
     // Commands help
-    uart_puts("\nCommands: overview, mem, help, exit\n");
+    uart_puts("\nCommands: overview, mem, slab, help, exit\n");
+}
+
+// Display slab cache utilization
+void monitor_show_slab() {
+    // Clear screen (ANSI escape sequence)
+    uart_puts("\033[2J\033[H");
+    
+    // Title
+    uart_puts("=== JasOS System Monitor - SLAB ===\n\n");
+    
+    uart_puts("Slab Caches:\n");
+    monitor_draw_line('-', 64);
+    uart_puts("NAME          OBJSIZE  OBJ/SLAB  SLABS  ACTIVE/TOTAL  WASTE\n");
+    monitor_draw_line('-', 64);
+    
+    char buf[16];
+    SlabStats stats;
+    for (unsigned int i = 0; kmem_cache_get_stats(i, &stats); i++) {
+        // Name
+        uart_puts(stats.name);
+        for (int pad = strlen(stats.name); pad < 14; pad++) uart_putc(' ');
+        
+        // Object size
+        monitor_int_to_str(stats.object_size, buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 9; pad++) uart_putc(' ');
+        
+        // Objects per slab
+        monitor_int_to_str(stats.objects_per_slab, buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 10; pad++) uart_putc(' ');
+        
+        // Slabs
+        monitor_int_to_str(stats.slab_count, buf);
+        uart_puts(buf);
+        for (int pad = strlen(buf); pad < 7; pad++) uart_putc(' ');
+        
+        // Active/total objects
+        monitor_int_to_str(stats.active_objects, buf);
+        uart_puts(buf);
+        uart_putc('/');
+        int width = strlen(buf) + 1;
+        monitor_int_to_str(stats.total_objects, buf);
+        uart_puts(buf);
+        for (int pad = width + strlen(buf); pad < 14; pad++) uart_putc(' ');
+        
+        // Internal waste
+        monitor_int_to_str(stats.waste_bytes, buf);
+        uart_puts(buf);
+        uart_puts(" B\n");
+        
+        // Utilization bar
+        unsigned int percentage = stats.total_objects ?
+            (stats.active_objects * 100) / stats.total_objects : 0;
+        uart_puts("  ");
+        monitor_draw_bar(percentage, 30);
+        uart_puts("\n");
+    }
+    
+    if (kmem_cache_count() == 0) {
+        uart_puts("  No caches\n");
+    }
+    
+    // Commands help
+    uart_puts("\nCommands: overview, mem, proc, help, exit\n");
 }
 
 // Display help screen
@@ -279,20 +482,40 @@ void monitor_show_help() {
     uart_puts("  overview - Show system overview\n");
     uart_puts("  mem      - Show detailed memory information\n");
     uart_puts("  proc     - Show detailed process information\n");
+    uart_puts("  slab     - Show slab cache utilization\n");
     uart_puts("  help     - Show this help screen\n");
     uart_puts("  exit     - Exit the monitor and return to shell\n");
     
     uart_puts("\nMemory Management:\n");
     monitor_draw_line('-', 50);
-    uart_puts("  Heap size:   256 KB\n");
-    uart_puts("  Allocation:  First-fit with block splitting/coalescing\n");
+    MemoryStats stats = memory_get_stats();
+    char buf[16];
+    uart_puts("  Heap size:   ");
+    monitor_int_to_str(stats.total_memory / 1024, buf);
+    uart_puts(buf);
+    uart_puts(" KB (grows to ");
+    monitor_int_to_str(stats.heap_limit / 1024, buf);
+    uart_puts(buf);
+    uart_puts(" KB of ");
+    monitor_int_to_str(stats.ram_size / 1024, buf);
+    uart_puts(buf);
+    uart_puts(" KB RAM)\n");
+    uart_puts("  Allocation:  Segregated size classes with splitting/coalescing\n");
+    uart_puts("  Page pool:   ");
+    monitor_int_to_str(stats.pages_total * (PAGE_SIZE / 1024), buf);
+    uart_puts(buf);
+    uart_puts(" KB buddy allocator (4 KB pages)\n");
     uart_puts("  Monitors:    Used/free memory, block fragmentation\n");
     
     uart_puts("\nProcess Management:\n");
     monitor_draw_line('-', 50);
-    uart_puts("  Max processes: 16\n");
-    uart_puts("  Scheduling:    Simple round-robin\n");
-    uart_puts("  Stack size:    4 KB per process\n");
+    uart_puts("  Max processes: 4096 (PCBs from a slab cache)\n");
+    if (process_get_sched_class() == SCHED_FAIR) {
+        uart_puts("  Scheduling:    Fair share, smallest weighted vruntime first\n");
+    } else {
+        uart_puts("  Scheduling:    32 priority queues, round-robin within a level\n");
+    }
+    uart_puts("  Stack size:    4 KB per process (buddy pages)\n");
     uart_puts("  States:        Ready, Running, Blocked, Terminated\n");
     
     // Commands help
@@ -301,6 +524,8 @@ void monitor_show_help() {
 
 // Update monitor display based on current mode
 void monitor_update() {
+    uart_capture_begin(monitor_frame, MONITOR_FRAME_SIZE);
+    
     switch (current_mode) {
         case MONITOR_OVERVIEW:
             monitor_show_overview();
@@ -311,6 +536,9 @@ void monitor_update() {
         case MONITOR_PROCESS:
             monitor_show_process();
             break;
+        case MONITOR_SLAB:
+            monitor_show_slab();
+            break;
         case MONITOR_HELP:
             monitor_show_help();
             break;
@@ -318,6 +546,8 @@ void monitor_update() {
             monitor_show_overview();
             break;
     }
+    
+    dma_uart_write(monitor_frame, uart_capture_end());
 }
 
 // Process monitor commands
@@ -329,6 +559,8 @@ void monitor_process_command(const char* cmd, const char* /* arg */) {
         current_mode = MONITOR_MEMORY;
     } else if (strcmp(cmd, "proc") == 0) {
         current_mode = MONITOR_PROCESS;
+    } else if (strcmp(cmd, "slab") == 0) {
+        current_mode = MONITOR_SLAB;
     } else if (strcmp(cmd, "help") == 0) {
         current_mode = MONITOR_HELP;
     } else if (strcmp(cmd, "exit") == 0) {
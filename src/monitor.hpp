@@ -12,6 +12,7 @@ enum MonitorMode {
     MONITOR_OVERVIEW,   // General system overview
     MONITOR_MEMORY,     // Detailed memory view
     MONITOR_PROCESS,    // Detailed process view
+    MONITOR_SLAB,       // Slab cache utilization
     MONITOR_HELP        // Help screen
 };
 
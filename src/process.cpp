@@ -1,27 +1,122 @@
 #include "process.hpp"
 #include "memory.hpp"
 #include "uart.hpp"
-
-// Forward declarations
-extern void* memset(void* s, int c, unsigned int n);
-extern char* strcpy(char* dest, const char* src);
-extern int strcmp(const char* s1, const char* s2);
+#include "irq.hpp"
+#include "timer.hpp"
+#include "kstring.hpp"
+#include "slab.hpp"
+#include "mmu.hpp"
+#include "ktimer.hpp"
+#include "sync.hpp"
 
 // Define NULL if not defined
 #ifndef NULL
 #define NULL 0
 #endif
 
-// Global process table
-static Process processes[MAX_PROCESSES];
-// Current running process index
-static int current_process = -1;
-// Number of processes
-static unsigned int process_count = 0;
+// Fair class tuning. Every runnable process gets a turn within the latency
+// period, in slices proportional to its weight. A new process preempts only
+// if it is at least the wakeup granularity behind the running one.
+#define FAIR_LATENCY_TICKS 6
+#define FAIR_WAKEUP_GRANULARITY_US (PROCESS_TICK_MS * 1000)
+// Load averages are sampled this often, as fixed-point numbers
+#define LOAD_SAMPLE_MS 100
+#define LOAD_FSHIFT 16
+#define LOAD_FIXED_1 (1u << LOAD_FSHIFT)
+// Priority whose weight is the unit; each level up weighs 1.25x more
+#define FAIR_BASE_PRIORITY 5
+#define FAIR_BASE_WEIGHT 1024
+
+// Process control blocks come from a slab cache
+static KmemCache* process_cache = NULL;
+// All processes in creation order
+static Process* process_list_head = NULL;
+static Process* process_list_tail = NULL;
+// Processes in each state (terminated ones: since boot), kept by process_set_state
+static unsigned int state_count[PROCESS_TERMINATED + 1];
+// Running process, and the one that runs when nothing else can
+static Process* current_process = NULL;
+static Process* idle_process = NULL;
+// PIDs in use, handed out round-robin so a PID is not reused right away
+static unsigned int pid_bitmap[PROCESS_MAX_PIDS / 32];
+static unsigned int pid_next = 0;
+// Lookup tables, chained through the PCBs
+static Process* pid_hash[PROCESS_PID_HASH_SIZE];
+static Process* name_hash[PROCESS_NAME_HASH_SIZE];
 // System uptime in milliseconds
 static unsigned int system_uptime_ms = 0;
-// CPU usage (percentage 0-100)
+// Busy (not idle) time since boot, and in the current CPU window
+static unsigned int busy_ms = 0;
+static unsigned int window_busy_ms = 0;
+static unsigned int window_ms = 0;
+// Index of the current CPU window, and percent busy over the last full one
+static unsigned int cpu_window = 0;
 static unsigned int cpu_usage = 0;
+// Processes waiting on a runqueue, kept up to date as they come and go
+static unsigned int queued_count = 0;
+// Load averages over 1, 10 and 60 s (fixed point) and their decay per
+// sample, exp(-LOAD_SAMPLE_MS / window)
+static unsigned int load_avg[3] = { 0, 0, 0 };
+static const unsigned int load_decay[3] = { 59300, 64884, 65427 };
+static unsigned int load_sample_ms = 0;
+// Ticks the current process has used of its time slice
+static unsigned int slice_ticks = 0;
+// Time slice per priority, in timer ticks
+static unsigned int time_slice[PROCESS_PRIORITY_LEVELS];
+// Ready queues, one FIFO per priority, and a bitmap of the non-empty ones
+static Process* ready_head[PROCESS_PRIORITY_LEVELS];
+static Process* ready_tail[PROCESS_PRIORITY_LEVELS];
+static unsigned int ready_bitmap = 0;
+// Scheduling class chosen at boot
+static SchedClass sched_class = SCHED_FAIR;
+// Fair class: runqueue ordered by vruntime, the total weight queued on it
+// and a vruntime floor that only moves forward
+static Process* fair_root = NULL;
+static unsigned int fair_queued_weight = 0;
+static unsigned int min_vruntime = 0;
+// Fair-share weight of each priority
+static unsigned int fair_weight[PROCESS_PRIORITY_LEVELS];
+// Real-time class: all periodic processes, the ready ones ordered by
+// deadline, and the share of the CPU they have reserved (in 1/1000)
+static Process* rt_list = NULL;
+static Process* edf_head = NULL;
+static unsigned int rt_utilization = 0;
+static unsigned int rt_count = 0;
+static unsigned int rt_misses_total = 0;
+// Context switches since boot, by cause, and per second over the last CPU window
+static unsigned int context_switches = 0;
+static unsigned int voluntary_switches = 0;
+static unsigned int involuntary_switches = 0;
+static unsigned int window_switches = 0;
+static unsigned int switch_rate = 0;
+// Set by process_yield so the switch it causes counts as voluntary
+static bool yielding = false;
+// Set by edf_tick when it stops a job that ran out of budget, which leaves
+// it blocked but is still a preemption
+static bool throttled = false;
+// Process that terminated itself, freed once another process runs
+static Process* dead_process = NULL;
+// Tickless idle, on once the tick interrupt runs. Time asleep in WFI (in
+// the current CPU window, and since boot), sleeps and tick interrupts saved.
+static bool idle_tickless = false;
+static unsigned int idle_window_us = 0;
+static unsigned int idle_residency = 0;
+static unsigned int idle_ms = 0;
+static unsigned int idle_us = 0;
+static unsigned int idle_sleeps = 0;
+static unsigned int idle_ticks_skipped = 0;
+// Wakeup latency, from the end of a sleep to the switch to the process it
+// woke (in counter ticks)
+static unsigned int wake_stamp = 0;
+static bool wake_pending = false;
+static unsigned int wakeups = 0;
+static unsigned int wake_ticks_total = 0;
+static unsigned int wake_ticks_max = 0;
+// Process blocked in uart_getc until the UART interrupt
+static Process* input_waiter = NULL;
+// Set while process_terminate hands on a dying process's mutexes, so the
+// wakeups it causes ask for a switch instead of making one half way through
+static bool wake_no_switch = false;
 
 // Helper function to convert int to string
 void process_int_to_str(unsigned int num, char* str) {
@@ -30,7 +125,7 @@ void process_int_to_str(unsigned int num, char* str) {
         str[1] = '\0';
         return;
     }
-
+    
     int i = 0;
     char temp[16];
     
@@ -42,279 +137,1552 @@ void process_int_to_str(unsigned int num, char* str) {
     for (int j = 0; j < i; j++) {
         str[j] = temp[i - j - 1];
     }
-    str[i] = '\0';
+    str[i] = '\0';
+}
+
+// Append a process to the ready queue of its priority
+static void ready_enqueue(Process* process) {
+    unsigned int priority = process->priority;
+    
+    process->queue_next = NULL;
+    process->queue_prev = ready_tail[priority];
+    if (ready_tail[priority]) {
+        ready_tail[priority]->queue_next = process;
+    } else {
+        ready_head[priority] = process;
+    }
+    ready_tail[priority] = process;
+    ready_bitmap |= 1u << priority;
+}
+
+// Take a process out of its ready queue
+static void ready_remove(Process* process) {
+    unsigned int priority = process->priority;
+    
+    if (process->queue_prev) {
+        process->queue_prev->queue_next = process->queue_next;
+    } else {
+        ready_head[priority] = process->queue_next;
+    }
+    if (process->queue_next) {
+        process->queue_next->queue_prev = process->queue_prev;
+    } else {
+        ready_tail[priority] = process->queue_prev;
+    }
+    process->queue_next = NULL;
+    process->queue_prev = NULL;
+    
+    if (ready_head[priority] == NULL) {
+        ready_bitmap &= ~(1u << priority);
+    }
+}
+
+// Head of the highest non-empty ready queue, found with one CLZ
+static Process* ready_first() {
+    if (ready_bitmap == 0) {
+        return NULL;
+    }
+    return ready_head[31 - __builtin_clz(ready_bitmap)];
+}
+
+// Wrap-safe order of vruntimes and uptimes
+static inline bool time_before(unsigned int a, unsigned int b) {
+    return (int)(a - b) < 0;
+}
+
+// Join two pairing heaps; the root with the larger vruntime becomes the
+// first child of the other. Both roots must have no siblings.
+static Process* heap_meld(Process* a, Process* b) {
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+    
+    if (time_before(b->vruntime, a->vruntime)) {
+        Process* t = a;
+        a = b;
+        b = t;
+    }
+    b->heap_prev = a;
+    b->heap_sibling = a->heap_child;
+    if (a->heap_child) {
+        a->heap_child->heap_prev = b;
+    }
+    a->heap_child = b;
+    return a;
+}
+
+// Turn a list of siblings back into one heap: meld them in pairs left to
+// right, then fold the pairs together right to left
+static Process* heap_merge_pairs(Process* first) {
+    Process* pairs = NULL;
+    while (first != NULL) {
+        Process* a = first;
+        Process* b = a->heap_sibling;
+        first = b ? b->heap_sibling : NULL;
+        
+        a->heap_sibling = NULL;
+        a->heap_prev = NULL;
+        if (b) {
+            b->heap_sibling = NULL;
+            b->heap_prev = NULL;
+        }
+        Process* pair = heap_meld(a, b);
+        
+        // Stack the pairs so the second pass sees them in reverse
+        pair->heap_sibling = pairs;
+        pairs = pair;
+    }
+    
+    Process* root = NULL;
+    while (pairs != NULL) {
+        Process* next = pairs->heap_sibling;
+        pairs->heap_sibling = NULL;
+        root = heap_meld(root, pairs);
+        pairs = next;
+    }
+    return root;
+}
+
+// Add a process to the fair runqueue. One that sat out (woken after being
+// blocked) starts near the front, but gets no credit for the time it did
+// not want the CPU.
+static void fair_enqueue(Process* process) {
+    unsigned int floor = min_vruntime - FAIR_LATENCY_TICKS * PROCESS_TICK_MS * 1000 / 2;
+    if (time_before(process->vruntime, floor)) {
+        process->vruntime = floor;
+    }
+    
+    process->heap_child = NULL;
+    process->heap_sibling = NULL;
+    process->heap_prev = NULL;
+    fair_root = heap_meld(fair_root, process);
+    fair_queued_weight += fair_weight[process->priority];
+}
+
+// Take any process off the fair runqueue
+static void fair_remove(Process* process) {
+    Process* children = heap_merge_pairs(process->heap_child);
+    
+    if (process == fair_root) {
+        fair_root = children;
+    } else {
+        // Unlink from the parent or the sibling before it
+        if (process->heap_prev->heap_child == process) {
+            process->heap_prev->heap_child = process->heap_sibling;
+        } else {
+            process->heap_prev->heap_sibling = process->heap_sibling;
+        }
+        if (process->heap_sibling) {
+            process->heap_sibling->heap_prev = process->heap_prev;
+        }
+        fair_root = heap_meld(fair_root, children);
+    }
+    
+    process->heap_child = NULL;
+    process->heap_sibling = NULL;
+    process->heap_prev = NULL;
+    fair_queued_weight -= fair_weight[process->priority];
+}
+
+// Move the vruntime floor up to the smallest vruntime that can still run
+static void fair_update_min() {
+    Process* current = current_process;
+    bool running = current->id != 0 && current->rt_period_ms == 0 && current->state == PROCESS_RUNNING;
+    
+    unsigned int lowest = min_vruntime;
+    if (running) {
+        lowest = current->vruntime;
+    }
+    if (fair_root != NULL && (!running || time_before(fair_root->vruntime, lowest))) {
+        lowest = fair_root->vruntime;
+    }
+    if (time_before(min_vruntime, lowest)) {
+        min_vruntime = lowest;
+    }
+}
+
+// Fair class: the latency period shared out by weight, in ticks
+static unsigned int fair_slice_ticks(Process* process) {
+    if (process->id == 0) {
+        return 1;
+    }
+    
+    unsigned int weight = fair_weight[process->priority];
+    unsigned int ticks = FAIR_LATENCY_TICKS * weight / (fair_queued_weight + weight);
+    return ticks ? ticks : 1;
+}
+
+// Insert a real-time process into the EDF queue, behind earlier deadlines
+static void edf_enqueue(Process* process) {
+    Process* prev = NULL;
+    Process* next = edf_head;
+    while (next != NULL && !time_before(process->rt_deadline, next->rt_deadline)) {
+        prev = next;
+        next = next->queue_next;
+    }
+    
+    process->queue_prev = prev;
+    process->queue_next = next;
+    if (prev) {
+        prev->queue_next = process;
+    } else {
+        edf_head = process;
+    }
+    if (next) {
+        next->queue_prev = process;
+    }
+}
+
+// Take a process out of the EDF queue
+static void edf_remove(Process* process) {
+    if (process->queue_prev) {
+        process->queue_prev->queue_next = process->queue_next;
+    } else {
+        edf_head = process->queue_next;
+    }
+    if (process->queue_next) {
+        process->queue_next->queue_prev = process->queue_prev;
+    }
+    process->queue_next = NULL;
+    process->queue_prev = NULL;
+}
+
+// Share of the CPU a periodic process reserves, in 1/1000, rounded up
+static unsigned int rt_share(unsigned int period_ms, unsigned int budget_ms) {
+    return (budget_ms * 1000 + period_ms - 1) / period_ms;
+}
+
+// Make a process runnable. Real-time processes go on the EDF queue, others
+// on the runqueue of the active class. The idle process is never queued; it
+// runs when everything is empty.
+static void runqueue_add(Process* process) {
+    queued_count++;
+    if (process->rt_period_ms != 0) {
+        edf_enqueue(process);
+    } else if (sched_class == SCHED_FAIR) {
+        fair_enqueue(process);
+    } else {
+        ready_enqueue(process);
+    }
+}
+
+// Take a process off its runqueue
+static void runqueue_remove(Process* process) {
+    queued_count--;
+    if (process->rt_period_ms != 0) {
+        edf_remove(process);
+    } else if (sched_class == SCHED_FAIR) {
+        fair_remove(process);
+    } else {
+        ready_remove(process);
+    }
+}
+
+// Take the process that should run next off the runqueue. Real-time
+// processes always come first, earliest deadline first.
+static Process* runqueue_pick() {
+    Process* next = edf_head;
+    if (next == NULL) {
+        next = sched_class == SCHED_FAIR ? fair_root : ready_first();
+    }
+    if (next == NULL) {
+        return idle_process;
+    }
+    runqueue_remove(next);
+    return next;
+}
+
+// Whether a process that just became ready should take the CPU right away
+static bool runqueue_preempts(Process* process) {
+    Process* current = current_process;
+    if (process->rt_period_ms != 0) {
+        return current->rt_period_ms == 0 || time_before(process->rt_deadline, current->rt_deadline);
+    }
+    if (current->rt_period_ms != 0) {
+        return false;
+    }
+    if (current->id == 0) {
+        return true;
+    }
+    if (sched_class == SCHED_FAIR) {
+        return time_before(process->vruntime + FAIR_WAKEUP_GRANULARITY_US, current->vruntime);
+    }
+    return process->priority > current->priority;
+}
+
+// Whether the running process has used up its time slice
+static bool runqueue_slice_expired() {
+    Process* current = current_process;
+    if (current->rt_period_ms != 0) {
+        // Runs until its job is done, its budget is gone or a deadline is earlier
+        return false;
+    }
+    if (sched_class == SCHED_FAIR) {
+        return slice_ticks >= fair_slice_ticks(current);
+    }
+    return slice_ticks >= time_slice[current->priority];
+}
+
+// Give a PCB and its stack back
+static void process_free(Process* process) {
+    if (process->stack != NULL) {
+        free_pages(process->stack, page_order(process->stack_size));
+    }
+    kmem_cache_free(process_cache, process);
+}
+
+// Free a process that terminated itself
+static void process_reap() {
+    if (dead_process != NULL) {
+        process_free(dead_process);
+        dead_process = NULL;
+    }
+}
+
+// Take the lowest free PID at or after pid_next, wrapping around
+static int pid_alloc() {
+    unsigned int pid = pid_next;
+    for (unsigned int scanned = 0; scanned <= PROCESS_MAX_PIDS; ) {
+        unsigned int word = pid / 32;
+        unsigned int free_bits = ~pid_bitmap[word] & (~0u << (pid % 32));
+        if (free_bits) {
+            pid = word * 32 + __builtin_ctz(free_bits);
+            pid_bitmap[word] |= 1u << (pid % 32);
+            pid_next = (pid + 1) % PROCESS_MAX_PIDS;
+            return pid;
+        }
+        scanned += 32 - pid % 32;
+        pid = (word + 1) * 32 % PROCESS_MAX_PIDS;
+    }
+    return -1;
+}
+
+// Hash of a process name for the name table (FNV-1a)
+static unsigned int process_name_hash(const char* name) {
+    unsigned int hash = 2166136261u;
+    while (*name) {
+        hash = (hash ^ (unsigned char)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+// Add a process to the process list and lookup tables
+static void process_link(Process* process) {
+    process->all_next = NULL;
+    process->all_prev = process_list_tail;
+    if (process_list_tail) {
+        process_list_tail->all_next = process;
+    } else {
+        process_list_head = process;
+    }
+    process_list_tail = process;
+    
+    Process** bucket = &pid_hash[process->id % PROCESS_PID_HASH_SIZE];
+    process->pid_next = *bucket;
+    process->pid_pprev = bucket;
+    if (*bucket) {
+        (*bucket)->pid_pprev = &process->pid_next;
+    }
+    *bucket = process;
+    
+    process->name_hash = process_name_hash(process->name);
+    bucket = &name_hash[process->name_hash % PROCESS_NAME_HASH_SIZE];
+    process->name_next = *bucket;
+    process->name_pprev = bucket;
+    if (*bucket) {
+        (*bucket)->name_pprev = &process->name_next;
+    }
+    *bucket = process;
+
+}
+
+// Remove a process from the process list and lookup tables, and free its PID
+static void process_unlink(Process* process) {
+    if (process->all_prev) {
+        process->all_prev->all_next = process->all_next;
+    } else {
+        process_list_head = process->all_next;
+    }
+    if (process->all_next) {
+        process->all_next->all_prev = process->all_prev;
+    } else {
+        process_list_tail = process->all_prev;
+    }
+    
+    *process->pid_pprev = process->pid_next;
+    if (process->pid_next) {
+        process->pid_next->pid_pprev = process->pid_pprev;
+    }
+    
+    *process->name_pprev = process->name_next;
+    if (process->name_next) {
+        process->name_next->name_pprev = process->name_pprev;
+    }
+    
+    pid_bitmap[process->id / 32] &= ~(1u << (process->id % 32));
+}
+
+// Move a process to a new state. Every state change goes through here, so
+// the per-state counts and the time each process spends in each state stay
+// exact. A new process comes out of TERMINATED, which is not timed.
+static void process_set_state(Process* process, ProcessState state) {
+    if (process->state != PROCESS_TERMINATED) {
+        state_count[process->state]--;
+        process->state_ms[process->state] += system_uptime_ms - process->state_since;
+    }
+    state_count[state]++;
+    process->state = state;
+    process->state_since = system_uptime_ms;
+}
+
+// Processes that exist (running, ready or blocked)
+static unsigned int process_live_count() {
+    return state_count[PROCESS_RUNNING] + state_count[PROCESS_READY] + state_count[PROCESS_BLOCKED];
+}
+
+// End the current job of a periodic process and wait for its next period
+static void process_wait_period() {
+    IrqGuard guard;
+    
+    Process* self = current_process;
+    self->rt_jobs++;
+    self->rt_job_done = true;
+    process_set_state(self, PROCESS_BLOCKED);
+    process_schedule();
+}
+
+// First code a new process runs. The switch into it left IRQs disabled.
+static void process_start() {
+    process_reap();
+    irq_enable();
+    
+    // A periodic process runs its entry once per period, until killed
+    Process* self = current_process;
+    if (self->rt_period_ms != 0) {
+        while (1) {
+            self->entry();
+            process_wait_period();
+        }
+    }
+    
+    self->entry();
+    process_exit();
+}
+
+// Tick periods until the next timed event: a kernel timer or a real-time
+// release. Everything else catches up after the sleep, which is capped at
+// one CPU window to keep that cheap.
+static unsigned int process_idle_ticks() {
+    unsigned int ms = PROCESS_CPU_WINDOW_MS;
+    for (Process* p = rt_list; p != NULL; p = p->rt_next) {
+        unsigned int left = time_before(system_uptime_ms, p->rt_deadline) ? p->rt_deadline - system_uptime_ms : 0;
+        if (left < ms) {
+            ms = left;
+        }
+    }
+    
+    unsigned int ticks = (ms + PROCESS_TICK_MS - 1) / PROCESS_TICK_MS;
+    return ktimer_next(ticks ? ticks : 1);
+}
+
+// Sleep in WFI until an interrupt arrives, with the tick interrupt held off
+// until the next timed event. IRQs stay disabled across the sleep so the
+// skipped ticks are accounted before the interrupt that woke us is taken.
+static void process_idle_sleep() {
+    IrqGuard guard;
+    
+    // Woken without a switch being asked for; let the runqueue have the CPU
+    if (queued_count != 0) {
+        process_yield();
+        return;
+    }
+    
+    timer_tick_defer(process_idle_ticks());
+    unsigned int start = timer_read();
+    cpu_wait_for_interrupt();
+    unsigned int now = timer_read();
+    unsigned int skipped = timer_tick_resume();
+    
+    unsigned int us = timer_ticks_to_us(now - start);
+    idle_window_us += us;
+    idle_us += us;
+    idle_ms += idle_us / 1000;
+    idle_us %= 1000;
+    idle_sleeps++;
+    idle_ticks_skipped += skipped;
+    if (skipped != 0) {
+        process_timer_tick(skipped * PROCESS_TICK_MS);
+    }
+    
+    wake_stamp = now;
+    wake_pending = true;
+}
+
+// Idle process: runs only when no other process is ready
+static void process_idle() {
+    while (1) {
+        if (idle_tickless) {
+            process_idle_sleep();
+        } else {
+            // No interrupts to wake up from yet
+            asm volatile("" : : : "memory");
+        }
+    }
+}
+
+// Timeout of a blocked process (its wait timer fired)
+static void process_wait_timeout(void* arg) {
+    Process* process = (Process*)arg;
+    process->timed_out = true;
+    process_wake(process);
+}
+
+// Block the calling process until process_wake, or until timeout_ms have
+// passed if it is not 0. Returns false if the timeout ended the wait.
+bool process_block(unsigned int timeout_ms) {
+    IrqGuard guard;
+    
+    Process* current = current_process;
+    if (current == idle_process) {
+        return false;
+    }
+    
+    current->waiting = true;
+    current->timed_out = false;
+    if (timeout_ms != 0) {
+        ktimer_arm(&current->wait_timer, timeout_ms);
+    }
+    process_set_state(current, PROCESS_BLOCKED);
+    process_schedule();
+    
+    return !current->timed_out;
+}
+
+// Make a process blocked in process_block runnable again. If it should
+// preempt, the switch happens right away when called from a process, and on
+// the way out when called from an interrupt handler.
+void process_wake(Process* process) {
+    IrqGuard guard;
+    
+    if (!process->waiting) {
+        return;
+    }
+    process->waiting = false;
+    ktimer_cancel(&process->wait_timer);
+    
+    process_set_state(process, PROCESS_READY);
+    runqueue_add(process);
+    if (process != current_process && runqueue_preempts(process)) {
+        if (irq_in_handler() || wake_no_switch) {
+            irq_request_schedule();
+        } else {
+            process_schedule();
+        }
+    }
+}
+
+// Schedule a process at another priority, as when it inherits one through
+// a mutex. Its own priority stays in base_priority.
+void process_boost(Process* process, unsigned int priority) {
+    IrqGuard guard;
+    
+    if (priority > PROCESS_PRIORITY_MAX) {
+        priority = PROCESS_PRIORITY_MAX;
+    }
+    if (process == idle_process || priority == process->priority) {
+        return;
+    }
+    
+    // A queued process moves to where the new priority puts it
+    bool queued = process->state == PROCESS_READY;
+    if (queued) {
+        runqueue_remove(process);
+    }
+    process->priority = priority;
+    if (queued) {
+        runqueue_add(process);
+    }
+}
+
+// In the fair class a boosted weight alone does not put a mutex owner ahead
+// of the processes it keeps the waiter from: give it the waiter's vruntime,
+// or the front of the runqueue if that comes sooner, so it runs next. The
+// difference is only lent. process_repay_vruntime adds it back once the
+// owner lets go of its mutexes, so it runs early, not for longer.
+void process_lend_vruntime(Process* process, const Process* waiter) {
+    IrqGuard guard;
+    
+    if (sched_class != SCHED_FAIR || process == idle_process || process->rt_period_ms != 0) {
+        return;
+    }
+    
+    unsigned int vruntime = waiter->vruntime;
+    if (fair_root != NULL && fair_root != process && !time_before(vruntime, fair_root->vruntime)) {
+        vruntime = fair_root->vruntime - 1;
+    }
+    if (!time_before(vruntime, process->vruntime)) {
+        return;
+    }
+    
+    unsigned int before = process->vruntime;
+    bool queued = process->state == PROCESS_READY;
+    if (queued) {
+        runqueue_remove(process);
+    }
+    process->vruntime = vruntime;
+    if (queued) {
+        runqueue_add(process);
+    }
+    
+    // fair_enqueue may have raised it to the floor again
+    if (time_before(process->vruntime, before)) {
+        process->vruntime_lent += before - process->vruntime;
+    }
+}
+
+// Charge back vruntime lent to a process. Returns true if there was any.
+bool process_repay_vruntime(Process* process) {
+    IrqGuard guard;
+    
+    if (process->vruntime_lent == 0) {
+        return false;
+    }
+    
+    bool queued = process->state == PROCESS_READY;
+    if (queued) {
+        runqueue_remove(process);
+    }
+    process->vruntime += process->vruntime_lent;
+    process->vruntime_lent = 0;
+    if (queued) {
+        runqueue_add(process);
+    }
+    return true;
+}
+
+// Sleep for at least ms milliseconds
+void process_sleep(unsigned int ms) {
+    if (ms == 0) {
+        process_yield();
+        return;
+    }
+    process_block(ms);
+}
+
+// Called by uart_getc while no input is waiting: block until the UART
+// interrupt says there is some. The console has one reader at a time;
+// anyone else polls.
+static void process_wait_input() {
+    IrqGuard guard;
+    
+    Process* current = current_process;
+    if (uart_rx_ready() || current == idle_process) {
+        return;
+    }
+    if (input_waiter != NULL) {
+        process_yield();
+        return;
+    }
+    
+    input_waiter = current;
+    uart_rx_interrupt(true);
+    process_block(0);
+}
+
+// UART interrupt: input arrived for the blocked reader. The interrupt stays
+// masked until somebody waits again, so it does not fire while the FIFO fills.
+static void process_input_irq() {
+    uart_rx_interrupt(false);
+    
+    Process* waiter = input_waiter;
+    if (waiter != NULL) {
+        input_waiter = NULL;
+        process_wake(waiter);
+    }
+}
+
+// Initialize the process system with the given scheduling class
+void process_init(SchedClass sched) {
+    // Empty process table; PCBs are allocated as processes are created
+    process_cache = kmem_cache_create("process", sizeof(Process), 8);
+    process_list_head = NULL;
+    process_list_tail = NULL;
+    for (int i = 0; i <= PROCESS_TERMINATED; i++) {
+        state_count[i] = 0;
+    }
+    for (int i = 0; i < PROCESS_MAX_PIDS / 32; i++) {
+        pid_bitmap[i] = 0;
+    }
+    pid_next = 0;
+    for (int i = 0; i < PROCESS_PID_HASH_SIZE; i++) {
+        pid_hash[i] = NULL;
+    }
+    for (int i = 0; i < PROCESS_NAME_HASH_SIZE; i++) {
+        name_hash[i] = NULL;
+    }
+    
+    // Empty ready queues, default time slices
+    for (int i = 0; i < PROCESS_PRIORITY_LEVELS; i++) {
+        ready_head[i] = NULL;
+        ready_tail[i] = NULL;
+        time_slice[i] = PROCESS_TIME_SLICE_TICKS;
+    }
+    ready_bitmap = 0;
+    
+    // Fair-share weights: 1.25x per priority level around the base
+    fair_weight[FAIR_BASE_PRIORITY] = FAIR_BASE_WEIGHT;
+    for (int i = FAIR_BASE_PRIORITY + 1; i < PROCESS_PRIORITY_LEVELS; i++) {
+        fair_weight[i] = fair_weight[i - 1] * 5 / 4;
+    }
+    for (int i = FAIR_BASE_PRIORITY - 1; i >= 0; i--) {
+        fair_weight[i] = fair_weight[i + 1] * 4 / 5;
+    }
+    fair_root = NULL;
+    fair_queued_weight = 0;
+    min_vruntime = 0;
+    rt_list = NULL;
+    edf_head = NULL;
+    rt_utilization = 0;
+    sched_class = sched;
+    ktimer_init();
+    
+    // Create idle process (pid 0)
+    idle_process = process_get_by_id(process_create("idle", process_idle, 0));
+    
+    // The boot code carries on as the shell process. It has no stack of its
+    // own; its registers are saved by the first switch away from it.
+    current_process = process_get_by_id(process_create("shell", NULL, 5));
+    process_set_state(current_process, PROCESS_RUNNING);
+}
+
+// Allocate and set up a process; it is not runnable yet
+static Process* process_alloc(const char* name, void (*entry_point)(), unsigned int priority) {
+    Process* process = (Process*)kmem_cache_alloc(process_cache);
+    if (process == NULL) {
+        return NULL;
+    }
+    
+    int pid = pid_alloc();
+    if (pid < 0) {
+        // Every PID is in use
+        kmem_cache_free(process_cache, process);
+        return NULL;
+    }
+    
+    // Copy name
+    int i = 0;
+    while (name[i] && i < MAX_PROCESS_NAME - 1) {
+        process->name[i] = name[i];
+        i++;
+    }
+    process->name[i] = '\0';
+    
+    // Allocate stack pages unless the process is the caller
+    if (entry_point != NULL) {
+        process->stack = (unsigned char*)alloc_pages(page_order(PROCESS_STACK_SIZE));
+        if (process->stack == NULL) {
+            // Memory allocation failed
+            pid_bitmap[pid / 32] &= ~(1u << (pid % 32));
+            kmem_cache_free(process_cache, process);
+            return NULL;
+        }
+        process->stack_size = PROCESS_STACK_SIZE;
+    } else {
+        process->stack = NULL;
+        process->stack_size = 0;
+    }
+    
+    // The first switch to the process enters process_start on its empty stack
+    CpuContext* context = &process->context;
+    for (int r = 0; r < 8; r++) {
+        context->r4_r11[r] = 0;
+    }
+    context->sp = reinterpret_cast<unsigned long>(process->stack + process->stack_size);
+    context->lr = reinterpret_cast<unsigned long>(process_start);
+    context->cpsr = CPSR_MODE_SVC | CPSR_I_BIT;
+    
+    // Priority 0 belongs to the idle process
+    if (priority > PROCESS_PRIORITY_MAX) {
+        priority = PROCESS_PRIORITY_MAX;
+    }
+    if (pid != 0 && priority == 0) {
+        priority = 1;
+    }
+    
+    // Initialize process
+    process->state = PROCESS_TERMINATED;
+    process->id = pid;
+    process->priority = priority;
+    process->base_priority = priority;
+    process->wait_queue = NULL;
+    process->wait_next = NULL;
+    process->wait_prev = NULL;
+    process->mutexes_held = NULL;
+    process->runtime_ms = 0;
+    process->created_at = system_uptime_ms;
+    process->entry = entry_point;
+    process->queue_next = NULL;
+    process->queue_prev = NULL;
+    process->vruntime = min_vruntime;
+    process->vruntime_lent = 0;
+    for (int s = 0; s < PROCESS_TERMINATED; s++) {
+        process->state_ms[s] = 0;
+    }
+    process->voluntary_switches = 0;
+    process->involuntary_switches = 0;
+    process->rt_period_ms = 0;
+    process->waiting = false;
+    process->timed_out = false;
+    ktimer_setup(&process->wait_timer, process_wait_timeout, process);
+    process->cpu_window = cpu_window;
+    process->cpu_ms = 0;
+    process->cpu_prev_ms = 0;
+    
+    process_link(process);
+    process_set_state(process, PROCESS_READY);
+    return process;
+}
+
+// Queue a new process, and run it right away if it should come before its creator
+static void process_admit(Process* process) {
+    runqueue_add(process);
+    
+    if (current_process != NULL && runqueue_preempts(process)) {
+        process_schedule();
+    }
+}
+
+// Create a new process. A NULL entry point adopts the calling context.
+int process_create(const char* name, void (*entry_point)(), unsigned int priority) {
+    IrqGuard guard;
+    
+    Process* process = process_alloc(name, entry_point, priority);
+    if (process == NULL) {
+        return -1;
+    }
+    
+    // A process adopting the caller is already running. One that runs first
+    // may also finish and be reaped before process_admit returns.
+    int id = process->id;
+    if (id != 0 && entry_point != NULL) {
+        process_admit(process);
+    }
+    
+    return id;
+}
+
+// Create a periodic real-time process: job runs once every period and may
+// use up to budget of CPU time each time, by a deadline at the end of the
+// period. Fails if the reservations would pass PROCESS_RT_MAX_UTILIZATION.
+int process_create_periodic(const char* name, void (*job)(), unsigned int period_ms, unsigned int budget_ms) {
+    IrqGuard guard;
+    
+    // Budgets are charged a tick at a time
+    period_ms = (period_ms + PROCESS_TICK_MS - 1) / PROCESS_TICK_MS * PROCESS_TICK_MS;
+    budget_ms = (budget_ms + PROCESS_TICK_MS - 1) / PROCESS_TICK_MS * PROCESS_TICK_MS;
+    if (job == NULL || budget_ms == 0 || budget_ms > period_ms) {
+        return -1;
+    }
+    
+    // Admission control: EDF meets every deadline while utilization is at
+    // most 100%, and some is kept back for everything else
+    unsigned int share = rt_share(period_ms, budget_ms);
+    if (rt_utilization + share > PROCESS_RT_MAX_UTILIZATION) {
+        return -1;
+    }
+    
+    Process* process = process_alloc(name, job, PROCESS_PRIORITY_MAX);
+    if (process == NULL) {
+        return -1;
+    }
+    
+    // The first job is released now
+    process->rt_period_ms = period_ms;
+    process->rt_budget_ms = budget_ms;
+    process->rt_budget_left = budget_ms;
+    process->rt_deadline = system_uptime_ms + period_ms;
+    process->rt_jobs = 0;
+    process->rt_misses = 0;
+    process->rt_job_done = false;
+    process->rt_next = rt_list;
+    rt_list = process;
+    rt_utilization += share;
+    rt_count++;
+    
+    process_admit(process);
+    return process->id;
+}
+
+// Terminate a process
+void process_terminate(unsigned int pid) {
+    IrqGuard guard;
+    
+    // The idle process must always be there to fall back on
+    Process* process = process_get_by_id(pid);
+    if (process == NULL || process == idle_process) {
+        return;
+    }
+    
+    // Off any wait queue, and its mutexes go to their next waiters
+    wake_no_switch = true;
+    sync_process_exit(process);
+    wake_no_switch = false;
+    
+    if (process->state == PROCESS_READY) {
+        runqueue_remove(process);
+    }
+    if (process == input_waiter) {
+        input_waiter = NULL;
+    }
+    ktimer_cancel(&process->wait_timer);
+    
+    // Give back the reservation of a real-time process
+    if (process->rt_period_ms != 0) {
+        Process** link = &rt_list;
+        while (*link != process) {
+            link = &(*link)->rt_next;
+        }
+        *link = process->rt_next;
+        rt_utilization -= rt_share(process->rt_period_ms, process->rt_budget_ms);
+        rt_count--;
+    }
+    
+    // Mark as terminated; it can no longer be looked up
+    process_set_state(process, PROCESS_TERMINATED);
+    process_unlink(process);
+    
+    // Free it, unless we are still running on its stack. In that case
+    // switch away for good and let the next process free it.
+    if (process == current_process) {
+        dead_process = process;
+        process_schedule();
+    } else {
+        process_free(process);
+    }
+}
+
+// Terminate the calling process
+void process_exit() {
+    process_terminate(current_process->id);
+}
+
+// Pick the next process and switch to it. The priority class runs the head
+// of the highest non-empty ready queue, round-robin within a priority; the
+// fair class runs the process with the smallest vruntime. Called by processes
+// that yield and by the timer interrupt at the end of a time slice.
+void process_schedule() {
+    IrqGuard guard;
+    
+    // A process that can still run goes back on the runqueue. Leaving the
+    // CPU is voluntary unless the process could have carried on.
+    Process* prev = current_process;
+    bool voluntary = yielding || (prev->state != PROCESS_RUNNING && !throttled);
+    yielding = false;
+    throttled = false;
+    if (prev->state == PROCESS_RUNNING) {
+        process_set_state(prev, PROCESS_READY);
+        if (prev != idle_process) {
+            runqueue_add(prev);
+        }
+    }
+    
+    Process* next = runqueue_pick();
+    process_set_state(next, PROCESS_RUNNING);
+    
+    // First switch after a sleep: how long the woken process waited for the CPU
+    if (wake_pending && prev == idle_process) {
+        wake_pending = false;
+        if (next != idle_process) {
+            unsigned int ticks = timer_read() - wake_stamp;
+            wakeups++;
+            wake_ticks_total += ticks;
+            if (ticks > wake_ticks_max) {
+                wake_ticks_max = ticks;
+            }
+        }
+    }
+    
+    slice_ticks = 0;
+    if (next == prev) {
+        return;
+    }
+    
+    current_process = next;
+    context_switches++;
+    if (voluntary) {
+        prev->voluntary_switches++;
+        voluntary_switches++;
+    } else {
+        prev->involuntary_switches++;
+        involuntary_switches++;
+    }
+    if (sched_class == SCHED_FAIR) {
+        fair_update_min();
+    }
+    
+    context_switch(&prev->context, &current_process->context);
+    
+    // Running again; the previous process may have terminated itself
+    process_reap();
+}
+
+// Voluntarily yield CPU
+void process_yield() {
+    IrqGuard guard;
+    
+    // In the fair class the yielding process goes behind the leftmost one,
+    // otherwise its own smaller vruntime would pick it again
+    Process* current = current_process;
+    if (sched_class == SCHED_FAIR && fair_root != NULL && current->id != 0 && current->rt_period_ms == 0 &&
+        !time_before(fair_root->vruntime, current->vruntime)) {
+        current->vruntime = fair_root->vruntime + 1;
+    }
+    
+    yielding = true;
+    process_schedule();
+}
+
+// Scheduling class chosen at boot
+SchedClass process_get_sched_class() {
+    return sched_class;
+}
+
+// Get current process
+Process* process_get_current() {
+    return current_process;
+}
+
+// Get process by ID
+Process* process_get_by_id(unsigned int pid) {
+    IrqGuard guard;
+    
+    for (Process* p = pid_hash[pid % PROCESS_PID_HASH_SIZE]; p != NULL; p = p->pid_next) {
+        if (p->id == pid) {
+            return p;
+        }
+    }
+    return NULL;
 }
 
-// Initialize the process system
-void process_init() {
-    // Clear process table
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        processes[i].state = PROCESS_TERMINATED;
-        processes[i].id = 0;
-        processes[i].stack = NULL;
-        processes[i].stack_size = 0;
-        processes[i].priority = 0;
-        processes[i].runtime_ms = 0;
-    }
-    
-    // Create idle process (pid 0)
-    process_create("idle", NULL, 0);
+// Get process by name (the most recently created one if names repeat)
+Process* process_get_by_name(const char* name) {
+    IrqGuard guard;
     
-    // Start with the idle process
-    current_process = 0;
-    processes[0].state = PROCESS_RUNNING;
+    unsigned int hash = process_name_hash(name);
+    for (Process* p = name_hash[hash % PROCESS_NAME_HASH_SIZE]; p != NULL; p = p->name_next) {
+        if (p->name_hash == hash && strcmp(p->name, name) == 0) {
+            return p;
+        }
+    }
+    return NULL;
 }
 
-// Create a new process
-int process_create(const char* name, void (*entry_point)(), unsigned int priority) {
-    // Find free slot in process table
-    int pid = -1;
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (processes[i].state == PROCESS_TERMINATED) {
-            pid = i;
-            break;
+// Real-time bookkeeping for one tick: charge the running job against its
+// budget and start new periods. A job still unfinished at its deadline is a
+// miss; it carries on with the next period's budget and deadline.
+static void edf_tick() {
+    Process* current = current_process;
+    if (current->rt_period_ms != 0 && current->state == PROCESS_RUNNING) {
+        if (current->rt_budget_left > PROCESS_TICK_MS) {
+            current->rt_budget_left -= PROCESS_TICK_MS;
+        } else {
+            // Out of budget: it sits out the rest of the period
+            current->rt_budget_left = 0;
+            process_set_state(current, PROCESS_BLOCKED);
+            throttled = true;
+            irq_request_schedule();
         }
     }
     
-    if (pid == -1) {
-        // No free slots
-        return -1;
+    for (Process* p = rt_list; p != NULL; p = p->rt_next) {
+        if (time_before(system_uptime_ms, p->rt_deadline)) {
+            continue;
+        }
+        
+        if (!p->rt_job_done) {
+            p->rt_misses++;
+            rt_misses_total++;
+        }
+        p->rt_deadline += p->rt_period_ms;
+        p->rt_budget_left = p->rt_budget_ms;
+        p->rt_job_done = false;
+        
+        // A process in process_block keeps waiting; process_wake queues it
+        // with the fresh deadline and budget
+        if (p->state == PROCESS_BLOCKED && !p->waiting) {
+            process_set_state(p, PROCESS_READY);
+            runqueue_add(p);
+        } else if (p->state == PROCESS_READY) {
+            // Its deadline moved; keep the queue in order
+            runqueue_remove(p);
+            runqueue_add(p);
+        }
     }
     
-    // Copy name
-    int i = 0;
-    while (name[i] && i < MAX_PROCESS_NAME - 1) {
-        processes[pid].name[i] = name[i];
-        i++;
+    if (edf_head != NULL && edf_head != current && runqueue_preempts(edf_head)) {
+        irq_request_schedule();
     }
-    processes[pid].name[i] = '\0';
+}
+
+// Timer interrupt: account the tick and preempt at the end of the time slice
+static void process_tick() {
+    process_timer_tick(PROCESS_TICK_MS);
+    edf_tick();
     
-    // Allocate stack if not idle process
-    if (entry_point != NULL) {
-        processes[pid].stack = (unsigned char*)memory_alloc(PROCESS_STACK_SIZE);
-        if (processes[pid].stack == NULL) {
-            // Memory allocation failed
-            return -1;
-        }
-        processes[pid].stack_size = PROCESS_STACK_SIZE;
-    } else {
-        // Idle process doesn't need a stack
-        processes[pid].stack = NULL;
-        processes[pid].stack_size = 0;
+    slice_ticks++;
+    if (runqueue_slice_expired()) {
+        irq_request_schedule();
     }
+}
+
+// Set the time slice of a priority level (rounded to whole timer ticks)
+void process_set_time_slice(unsigned int priority, unsigned int ms) {
+    if (priority >= PROCESS_PRIORITY_LEVELS) return;
     
-    // Initialize process
-    processes[pid].state = PROCESS_READY;
-    processes[pid].id = pid;
-    processes[pid].priority = priority;
-    processes[pid].runtime_ms = 0;
-    processes[pid].created_at = system_uptime_ms;
+    unsigned int ticks = ms / PROCESS_TICK_MS;
+    time_slice[priority] = ticks ? ticks : 1;
+}
+
+// Get the time slice of a priority level in milliseconds
+unsigned int process_get_time_slice(unsigned int priority) {
+    if (priority >= PROCESS_PRIORITY_LEVELS) return 0;
     
-    // Increment process count
-    process_count++;
+    return time_slice[priority] * PROCESS_TICK_MS;
+}
+
+// Fair-share weight of a priority level
+unsigned int process_get_weight(unsigned int priority) {
+    if (priority >= PROCESS_PRIORITY_LEVELS) return 0;
     
-    return pid;
+    return fair_weight[priority];
 }
 
-// Terminate a process
-void process_terminate(unsigned int pid) {
-    if (pid >= MAX_PROCESSES || processes[pid].state == PROCESS_TERMINATED) {
-        return;
-    }
+// Share of the CPU reserved by real-time processes, in tenths of a percent
+unsigned int process_get_rt_utilization() {
+    return rt_utilization;
+}
+
+// Start the timer interrupt that drives preemption. With interrupts
+// running, the idle process can sleep and console reads can block.
+void process_start_preemption() {
+    timer_tick_start(PROCESS_TICK_HZ, process_tick);
     
-    // Free the stack
-    if (processes[pid].stack != NULL) {
-        memory_free(processes[pid].stack);
-        processes[pid].stack = NULL;
+    irq_register(IRQ_UART0, process_input_irq);
+    uart_set_rx_wait(process_wait_input);
+    idle_tickless = true;
+}
+
+// Charge CPU time to a process's current window. A process that has not
+// run for a while catches up here, so nothing walks all processes.
+static void process_charge_cpu(Process* process, unsigned int ms) {
+    if (process->cpu_window != cpu_window) {
+        process->cpu_prev_ms = process->cpu_window + 1 == cpu_window ? process->cpu_ms : 0;
+        process->cpu_ms = 0;
+        process->cpu_window = cpu_window;
     }
-    
-    // Mark as terminated
-    processes[pid].state = PROCESS_TERMINATED;
-    
-    // Decrement process count
-    process_count--;
-    
-    // If terminating current process, force reschedule
-    if ((int)pid == current_process) {
-        process_schedule();
+    process->cpu_ms += ms;
+}
+
+// Percent of the CPU a process used over the last full CPU window
+unsigned int process_get_cpu_percent(Process* process) {
+    unsigned int ms = 0;
+    if (process->cpu_window == cpu_window) {
+        ms = process->cpu_prev_ms;
+    } else if (process->cpu_window + 1 == cpu_window) {
+        ms = process->cpu_ms;
     }
+    return ms * 100 / PROCESS_CPU_WINDOW_MS;
 }
 
-// Simplified scheduler (round-robin)
-void process_schedule() {
-    // Currently we're implementing a very simple round-robin scheduler
-    int next_process = current_process;
+// Time a process has spent in a live state, including its current stay
+unsigned int process_get_state_time(Process* process, ProcessState state) {
+    if (state >= PROCESS_TERMINATED) return 0;
     
-    // Find next ready process
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        next_process = (next_process + 1) % MAX_PROCESSES;
-        if (processes[next_process].state == PROCESS_READY) {
-            break;
-        }
+    unsigned int ms = process->state_ms[state];
+    if (process->state == state) {
+        ms += system_uptime_ms - process->state_since;
     }
+    return ms;
+}
+
+// Move an exponentially decayed load average one sample towards n
+static unsigned int load_update(unsigned int load, unsigned int n, unsigned int decay) {
+    unsigned long long sum = (unsigned long long)load * decay +
+                             (unsigned long long)(n << LOAD_FSHIFT) * (LOAD_FIXED_1 - decay);
+    return (unsigned int)((sum + LOAD_FIXED_1 / 2) >> LOAD_FSHIFT);
+}
+
+// Update system time (called from the timer interrupt). Constant time:
+// only the running process and a few totals are touched.
+void process_timer_tick(unsigned int ms) {
+    system_uptime_ms += ms;
     
-    // If no ready process found, use idle process
-    if (processes[next_process].state != PROCESS_READY) {
-        next_process = 0;  // Idle process
+    // Kernel timers; after a tickless sleep the wheel catches up tick by tick
+    for (unsigned int t = ms / PROCESS_TICK_MS; t > 0; t--) {
+        ktimer_tick();
     }
     
-    // If different process selected, perform context switch
-    if (next_process != current_process && current_process >= 0) {
-        // Mark current as ready (if it was running)
-        if (processes[current_process].state == PROCESS_RUNNING) {
-            processes[current_process].state = PROCESS_READY;
+    // Update current process runtime, and its vruntime at the rate of its weight
+    bool busy = false;
+    if (current_process != NULL && current_process->state == PROCESS_RUNNING) {
+        Process* current = current_process;
+        current->runtime_ms += ms;
+        if (current->id != 0 && current->rt_period_ms == 0) {
+            current->vruntime += ms * 1000 * FAIR_BASE_WEIGHT / fair_weight[current->priority];
+        }
+        if (sched_class == SCHED_FAIR) {
+            fair_update_min();
         }
+        process_charge_cpu(current, ms);
+        busy = current != idle_process;
     }
     
-    // Update current process
-    current_process = next_process;
-    processes[current_process].state = PROCESS_RUNNING;
+    // CPU usage over fixed windows
+    if (busy) {
+        busy_ms += ms;
+        window_busy_ms += ms;
+    }
+    window_ms += ms;
+    if (window_ms >= PROCESS_CPU_WINDOW_MS) {
+        cpu_usage = window_busy_ms * 100 / window_ms;
+        idle_residency = idle_window_us / (window_ms * 10);
+        if (idle_residency > 100) {
+            idle_residency = 100;
+        }
+        idle_window_us = 0;
+        switch_rate = (context_switches - window_switches) * 1000 / window_ms;
+        window_switches = context_switches;
+        window_busy_ms = 0;
+        window_ms = 0;
+        cpu_window++;
+    }
     
-    // Note: In a real OS, we would save/restore context here
-    // For our simulation, we're just updating state
-}
-
-// Voluntarily yield CPU
-void process_yield() {
-    process_schedule();
+    // Load averages of the number of runnable processes. After a tickless
+    // sleep several samples may be due at once.
+    load_sample_ms += ms;
+    while (load_sample_ms >= LOAD_SAMPLE_MS) {
+        load_sample_ms -= LOAD_SAMPLE_MS;
+        unsigned int runnable = queued_count + (busy ? 1 : 0);
+        for (int i = 0; i < 3; i++) {
+            load_avg[i] = load_update(load_avg[i], runnable, load_decay[i]);
+        }
+    }
 }
 
-// Get current process
-Process* process_get_current() {
-    if (current_process >= 0) {
-        return &processes[current_process];
+// Get process statistics
+ProcessStats process_get_stats() {
+    ProcessStats stats;
+    IrqGuard guard;
+    
+    // Everything is kept up to date as it changes; nothing is counted here
+    stats.running_processes = state_count[PROCESS_RUNNING];
+    stats.ready_processes = state_count[PROCESS_READY];
+    stats.blocked_processes = state_count[PROCESS_BLOCKED];
+    stats.terminated_processes = state_count[PROCESS_TERMINATED];
+    stats.total_processes = process_live_count();
+    
+    stats.cpu_usage = cpu_usage;
+    stats.cpu_usage_total = system_uptime_ms >= 100 ? busy_ms / (system_uptime_ms / 100) : 0;
+    for (int i = 0; i < 3; i++) {
+        stats.load_avg[i] = (unsigned int)(((unsigned long long)load_avg[i] * 100 + LOAD_FIXED_1 / 2) >> LOAD_FSHIFT);
     }
-    return NULL;
+    stats.context_switches = context_switches;
+    stats.voluntary_switches = voluntary_switches;
+    stats.involuntary_switches = involuntary_switches;
+    stats.switch_rate = switch_rate;
+    stats.rt_processes = rt_count;
+    stats.deadline_misses = rt_misses_total;
+    stats.idle_residency = idle_residency;
+    stats.idle_residency_total = system_uptime_ms >= 100 ? idle_ms / (system_uptime_ms / 100) : 0;
+    stats.idle_sleeps = idle_sleeps;
+    stats.idle_ticks_skipped = idle_ticks_skipped;
+    stats.wakeups = wakeups;
+    stats.wakeup_latency_ns = wakeups ? timer_ticks_to_ns(wake_ticks_total / wakeups) : 0;
+    stats.wakeup_latency_max_ns = timer_ticks_to_ns(wake_ticks_max);
+    
+    return stats;
 }
 
-// Get process by ID
-Process* process_get_by_id(unsigned int pid) {
-    if (pid < MAX_PROCESSES) {
-        return &processes[pid];
+// Print a number with a unit, padded with spaces to a column width
+static void process_put_column(unsigned int value, const char* unit, int width) {
+    char buf[16];
+    process_int_to_str(value, buf);
+    uart_puts(buf);
+    uart_puts(unit);
+    width -= (int)(strlen(buf) + strlen(unit));
+    while (width-- > 0) {
+        uart_putc(' ');
     }
-    return NULL;
 }
 
-// Get process by name
-Process* process_get_by_name(const char* name) {
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (processes[i].state != PROCESS_TERMINATED) {
-            if (strcmp(processes[i].name, name) == 0) {
-                return &processes[i];
+// Processes shown in the activity bar of ps
+#define PROCESS_DUMP_ACTIVITY 64
+// Processes shown in the tables of ps
+#define PROCESS_DUMP_ROWS 64
+// Queued processes ps lists per priority or in vruntime order
+#define PROCESS_DUMP_QUEUED 32
+
+// Ready queues from the highest priority down, in run order
+static void process_dump_priority() {
+    char buf[16];
+    
+    uart_puts("\nScheduler: priority\nReady Queues (PRIORITY [SLICE]: PIDS):\n");
+    unsigned int flags = irq_save();
+    for (int priority = PROCESS_PRIORITY_MAX; priority >= 0; priority--) {
+        bool running_here = current_process->priority == (unsigned int)priority &&
+                            current_process->rt_period_ms == 0;
+        if (!(ready_bitmap & (1u << priority)) && !running_here) {
+            continue;
+        }
+        
+        uart_puts("  ");
+        process_int_to_str(priority, buf);
+        if (priority < 10) uart_putc(' ');
+        uart_puts(buf);
+        uart_puts(" [");
+        process_int_to_str(process_get_time_slice(priority), buf);
+        uart_puts(buf);
+        uart_puts(" ms]:");
+        if (running_here) {
+            uart_puts(" (");
+            process_int_to_str(current_process->id, buf);
+            uart_puts(buf);
+            uart_puts(" running)");
+        }
+        int shown = 0;
+        for (Process* p = ready_head[priority]; p != NULL; p = p->queue_next) {
+            if (shown++ == PROCESS_DUMP_QUEUED) {
+                uart_puts(" ...");
+                break;
             }
+            uart_putc(' ');
+            process_int_to_str(p->id, buf);
+            uart_puts(buf);
         }
+        uart_puts("\n");
     }
-    return NULL;
+    irq_restore(flags);
 }
 
-// Update system time (should be called by timer interrupt)
-void process_timer_tick(unsigned int ms) {
-    system_uptime_ms += ms;
+// Print a number of hundredths as a decimal, e.g. 152 as 1.52
+static void process_put_hundredths(unsigned int value) {
+    char buf[16];
+    process_int_to_str(value / 100, buf);
+    uart_puts(buf);
+    uart_putc('.');
+    uart_putc('0' + value % 100 / 10);
+    uart_putc('0' + value % 10);
+}
+
+// Fair runqueue in run order (smallest vruntime first)
+static void process_dump_fair() {
+    char buf[16];
+    
+    uart_puts("\nScheduler: fair  (min vruntime ");
+    process_int_to_str(min_vruntime / 1000, buf);
+    uart_puts(buf);
+    uart_puts(" ms, queued weight ");
+    process_int_to_str(fair_queued_weight, buf);
+    uart_puts(buf);
+    uart_puts(")\nRunqueue (PID [WEIGHT]):");
     
-    // Update current process runtime
-    if (current_process >= 0 && processes[current_process].state == PROCESS_RUNNING) {
-        processes[current_process].runtime_ms += ms;
+    unsigned int flags = irq_save();
+    if (current_process != idle_process && current_process->rt_period_ms == 0) {
+        uart_puts(" (");
+        process_int_to_str(current_process->id, buf);
+        uart_puts(buf);
+        uart_puts(" running)");
     }
     
-    // Calculate CPU usage (excluding idle process)
-    unsigned int total_runtime = 0;
-    for (int i = 1; i < MAX_PROCESSES; i++) {  // Skip idle process
-        if (processes[i].state != PROCESS_TERMINATED) {
-            total_runtime += processes[i].runtime_ms;
+    // The heap is only ordered at its root; sort the first few for display
+    Process* order[PROCESS_DUMP_QUEUED];
+    int count = 0;
+    bool more = false;
+    for (Process* p = process_list_head; p != NULL; p = p->all_next) {
+        if (p->state != PROCESS_READY || p->rt_period_ms != 0 || p == idle_process) continue;
+        
+        int j = count;
+        if (count < PROCESS_DUMP_QUEUED) {
+            count++;
+        } else {
+            more = true;
+            if (!time_before(p->vruntime, order[count - 1]->vruntime)) continue;
+            j = count - 1;
+        }
+        while (j > 0 && time_before(p->vruntime, order[j - 1]->vruntime)) {
+            order[j] = order[j - 1];
+            j--;
         }
+        order[j] = p;
+    }
+    for (int i = 0; i < count; i++) {
+        uart_putc(' ');
+        process_int_to_str(order[i]->id, buf);
+        uart_puts(buf);
+        uart_puts(" [");
+        process_int_to_str(fair_weight[order[i]->priority], buf);
+        uart_puts(buf);
+        uart_puts("]");
+    }
+    if (more) {
+        uart_puts(" ...");
+    }
+    irq_restore(flags);
+    uart_puts("\n");
+}
+
+// Real-time processes with their reservations and deadline misses
+static void process_dump_rt() {
+    char buf[16];
+    
+    uart_puts("\nReal-time (EDF) processes, ");
+    process_int_to_str(rt_utilization / 10, buf);
+    uart_puts(buf);
+    uart_putc('.');
+    process_int_to_str(rt_utilization % 10, buf);
+    uart_puts(buf);
+    uart_puts("% of the CPU reserved:\n");
+    uart_puts("PID  PERIOD    BUDGET    DEADLINE  JOBS      MISSES\n");
+    
+    unsigned int flags = irq_save();
+    for (Process* p = rt_list; p != NULL; p = p->rt_next) {
+        process_put_column(p->id, "", 5);
+        process_put_column(p->rt_period_ms, "ms", 10);
+        process_put_column(p->rt_budget_ms, "ms", 10);
+        // Time left until the deadline of the current job
+        process_put_column(p->rt_deadline - system_uptime_ms, "ms", 10);
+        process_put_column(p->rt_jobs, "", 10);
+        process_int_to_str(p->rt_misses, buf);
+        uart_puts(buf);
+        uart_puts("\n");
     }
     
-    if (system_uptime_ms > 0) {
-        cpu_usage = (total_runtime * 100) / system_uptime_ms;
-    } else {
-        cpu_usage = 0;
+    uart_puts("EDF queue (by deadline):");
+    for (Process* p = edf_head; p != NULL; p = p->queue_next) {
+        uart_putc(' ');
+        process_int_to_str(p->id, buf);
+        uart_puts(buf);
     }
+    irq_restore(flags);
+    uart_puts("\n");
 }
 
-// Get process statistics
-ProcessStats process_get_stats() {
-    ProcessStats stats;
-    stats.total_processes = 0;
-    stats.running_processes = 0;
-    stats.ready_processes = 0;
-    stats.blocked_processes = 0;
-    stats.terminated_processes = 0;
-    
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        switch (processes[i].state) {
+// A process as ps prints it, copied so the printing can run with IRQs on
+struct ProcessDumpRow {
+    unsigned int id;
+    ProcessState state;
+    unsigned int priority;
+    unsigned int runtime_ms;
+    unsigned int vruntime_ms;
+    unsigned int state_ms[PROCESS_TERMINATED];
+    unsigned int cpu_percent;
+    unsigned int voluntary_switches;
+    unsigned int involuntary_switches;
+    char name[MAX_PROCESS_NAME];
+};
+
+static ProcessDumpRow dump_rows[PROCESS_DUMP_ROWS];
+
+// Note the rows a ps table left out
+static void process_dump_more(unsigned int more) {
+    if (more == 0) {
+        return;
+    }
+    char buf[16];
+    uart_puts("... ");
+    process_int_to_str(more, buf);
+    uart_puts(buf);
+    uart_puts(" more\n");
+}
+
+// Display processes
+void process_dump() {
+    ProcessStats stats = process_get_stats();
+    
+    uart_puts("Process List:\n");
+    uart_puts("-----------------------------------------------------------------------\n");
+    uart_puts("PID  STATE     PRIORITY  RUNTIME   VRUNTIME  WAIT      CPU  NAME\n");
+    uart_puts("-----------------------------------------------------------------------\n");
+    
+    // Copy the rows with IRQs off, then print them with IRQs on: printing
+    // to the polled UART takes long enough to lose timer ticks
+    unsigned int rows = 0;
+    unsigned int total = 0;
+    unsigned int flags = irq_save();
+    for (Process* p = process_list_head; p != NULL; p = p->all_next, total++) {
+        if (rows == PROCESS_DUMP_ROWS) continue;
+        
+        ProcessDumpRow* row = &dump_rows[rows++];
+        row->id = p->id;
+        row->state = p->state;
+        row->priority = p->priority;
+        row->runtime_ms = p->runtime_ms;
+        row->vruntime_ms = p->vruntime / 1000;
+        for (int s = 0; s < PROCESS_TERMINATED; s++) {
+            row->state_ms[s] = process_get_state_time(p, (ProcessState)s);
+        }
+        row->cpu_percent = process_get_cpu_percent(p);
+        row->voluntary_switches = p->voluntary_switches;
+        row->involuntary_switches = p->involuntary_switches;
+        strcpy(row->name, p->name);
+    }
+    irq_restore(flags);
+    
+    for (unsigned int i = 0; i < rows; i++) {
+        ProcessDumpRow* row = &dump_rows[i];
+        
+        // PID
+        char buf[16];
+        process_put_column(row->id, "", 5);
+        
+        // State
+        switch (row->state) {
             case PROCESS_RUNNING:
-                stats.running_processes++;
-                stats.total_processes++;
+                uart_puts("RUNNING  ");
                 break;
             case PROCESS_READY:
-                stats.ready_processes++;
-                stats.total_processes++;
+                uart_puts("READY    ");
                 break;
             case PROCESS_BLOCKED:
-                stats.blocked_processes++;
-                stats.total_processes++;
+                uart_puts("BLOCKED  ");
                 break;
-            case PROCESS_TERMINATED:
-                stats.terminated_processes++;
+            default:
+                uart_puts("UNKNOWN  ");
                 break;
         }
+        
+        // Priority
+        process_int_to_str(row->priority, buf);
+        if (row->priority < 10) uart_putc(' ');
+        uart_puts(buf);
+        uart_puts("        ");
+        
+        // Runtime, weighted runtime and time spent waiting to run
+        process_put_column(row->runtime_ms, "ms", 10);
+        process_put_column(row->vruntime_ms, "ms", 10);
+        process_put_column(row->state_ms[PROCESS_READY], "ms", 10);
+        
+        // Share of the CPU over the last window
+        process_put_column(row->cpu_percent, "%", 5);
+        
+        // Name
+        uart_puts(row->name);
+        uart_puts("\n");
     }
+    process_dump_more(total - rows);
     
-    stats.cpu_usage = cpu_usage;
-    
-    return stats;
-}
-
-// Display processes
-void process_dump() {
-    ProcessStats stats = process_get_stats();
-    
-    uart_puts("Process List:\n");
-    uart_puts("--------------------------------------------------\n");
-    uart_puts("PID  STATE     PRIORITY  RUNTIME   NAME\n");
-    uart_puts("--------------------------------------------------\n");
-    
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (processes[i].state != PROCESS_TERMINATED) {
-            // PID
-            char buf[16];
-            process_int_to_str(processes[i].id, buf);
-            if (processes[i].id < 10) uart_putc(' ');
-            uart_puts(buf);
-            uart_puts("   ");
-            
-            // State
-            switch (processes[i].state) {
-                case PROCESS_RUNNING:
-                    uart_puts("RUNNING  ");
-                    break;
-                case PROCESS_READY:
-                    uart_puts("READY    ");
-                    break;
-                case PROCESS_BLOCKED:
-                    uart_puts("BLOCKED  ");
-                    break;
-                default:
-                    uart_puts("UNKNOWN  ");
-                    break;
-            }
-            
-            // Priority
-            process_int_to_str(processes[i].priority, buf);
-            if (processes[i].priority < 10) uart_putc(' ');
-            uart_puts(buf);
-            uart_puts("        ");
-            
-            // Runtime
-            process_int_to_str(processes[i].runtime_ms, buf);
-            uart_puts(buf);
-            uart_puts("ms    ");
-            
-            // Name
-            uart_puts(processes[i].name);
-            uart_puts("\n");
-        }
+    // Where each process has spent its time, and how it left the CPU
+    uart_puts("\nPID  READY     RUNNING   BLOCKED   VOLUNTARY PREEMPTED\n");
+    for (unsigned int i = 0; i < rows; i++) {
+        ProcessDumpRow* row = &dump_rows[i];
+        process_put_column(row->id, "", 5);
+        process_put_column(row->state_ms[PROCESS_READY], "ms", 10);
+        process_put_column(row->state_ms[PROCESS_RUNNING], "ms", 10);
+        process_put_column(row->state_ms[PROCESS_BLOCKED], "ms", 10);
+        process_put_column(row->voluntary_switches, "", 10);
+        process_put_column(row->involuntary_switches, "", 0);
+        uart_puts("\n");
     }
+    process_dump_more(total - rows);
     
     // Statistics
     uart_puts("\nProcess Statistics:\n");
@@ -322,7 +1690,10 @@ void process_dump() {
     char buf[16];
     process_int_to_str(stats.total_processes, buf);
     uart_puts(buf);
-    uart_puts("\n");
+    uart_puts("  (");
+    process_int_to_str(stats.terminated_processes, buf);
+    uart_puts(buf);
+    uart_puts(" terminated since boot)\n");
     
     uart_puts("  Running:  ");
     process_int_to_str(stats.running_processes, buf);
@@ -338,24 +1709,326 @@ void process_dump() {
     uart_puts("  CPU Usage:  ");
     process_int_to_str(stats.cpu_usage, buf);
     uart_puts(buf);
-    uart_puts("%\n");
+    uart_puts("% (last second), ");
+    process_int_to_str(stats.cpu_usage_total, buf);
+    uart_puts(buf);
+    uart_puts("% since boot\n");
+    
+    uart_puts("  Load average:  ");
+    for (int i = 0; i < 3; i++) {
+        process_put_hundredths(stats.load_avg[i]);
+        uart_puts("  ");
+    }
+    uart_puts("(1 s, 10 s, 60 s)\n");
+    
+    uart_puts("  Context switches:  ");
+    process_int_to_str(stats.context_switches, buf);
+    uart_puts(buf);
+    uart_puts(" (");
+    process_int_to_str(stats.voluntary_switches, buf);
+    uart_puts(buf);
+    uart_puts(" voluntary, ");
+    process_int_to_str(stats.involuntary_switches, buf);
+    uart_puts(buf);
+    uart_puts(" preempted), ");
+    process_int_to_str(stats.switch_rate, buf);
+    uart_puts(buf);
+    uart_puts("/s\n");
+    
+    uart_puts("  Real-time:  ");
+    process_int_to_str(stats.rt_processes, buf);
+    uart_puts(buf);
+    uart_puts("  Deadline misses:  ");
+    process_int_to_str(stats.deadline_misses, buf);
+    uart_puts(buf);
+    uart_puts("\n");
+    
+    uart_puts("  Idle:  ");
+    process_int_to_str(stats.idle_residency, buf);
+    uart_puts(buf);
+    uart_puts("% asleep (last second), ");
+    process_int_to_str(stats.idle_residency_total, buf);
+    uart_puts(buf);
+    uart_puts("% since boot, ");
+    process_int_to_str(stats.idle_sleeps, buf);
+    uart_puts(buf);
+    uart_puts(" sleeps, ");
+    process_int_to_str(stats.idle_ticks_skipped, buf);
+    uart_puts(buf);
+    uart_puts(" ticks skipped\n");
+    
+    uart_puts("  Wakeup latency:  ");
+    process_int_to_str(stats.wakeup_latency_ns, buf);
+    uart_puts(buf);
+    uart_puts(" ns average, ");
+    process_int_to_str(stats.wakeup_latency_max_ns, buf);
+    uart_puts(buf);
+    uart_puts(" ns max (");
+    process_int_to_str(stats.wakeups, buf);
+    uart_puts(buf);
+    uart_puts(" wakeups)\n");
+    
+    KTimerStats timers = ktimer_get_stats();
+    uart_puts("  Timers:  ");
+    process_int_to_str(timers.pending, buf);
+    uart_puts(buf);
+    uart_puts(" pending, ");
+    process_int_to_str(timers.expired, buf);
+    uart_puts(buf);
+    uart_puts(" expired, longest tick ");
+    process_int_to_str(timers.max_tick_ns, buf);
+    uart_puts(buf);
+    uart_puts(" ns\n");
     
     // Visual representation
     uart_puts("\nProcess Activity:\n");
     uart_puts("[");
     
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (i == current_process) {
+    int shown = 0;
+    flags = irq_save();
+    for (Process* p = process_list_head; p != NULL; p = p->all_next) {
+        if (shown++ == PROCESS_DUMP_ACTIVITY) {
+            uart_puts("...");
+            break;
+        }
+        if (p == current_process) {
             uart_putc('R');  // Running
-        } else if (processes[i].state == PROCESS_READY) {
+        } else if (p->state == PROCESS_READY) {
             uart_putc('r');  // Ready
-        } else if (processes[i].state == PROCESS_BLOCKED) {
-            uart_putc('b');  // Blocked
         } else {
-            uart_putc('.');  // Terminated or unused
+            uart_putc('b');  // Blocked
         }
     }
+    irq_restore(flags);
     
     uart_puts("]\n");
-    uart_puts("Legend: R = Running, r = Ready, b = Blocked, . = Terminated\n");
-} 
\ No newline at end of file
+    uart_puts("Legend: R = Running, r = Ready, b = Blocked (in creation order)\n");
+    
+    if (rt_list != NULL) {
+        process_dump_rt();
+    }
+    if (sched_class == SCHED_FAIR) {
+        process_dump_fair();
+    } else {
+        process_dump_priority();
+    }
+}
+
+// Number of switches each benchmark performs
+#define BENCH_SWITCHES 10000
+
+// Contexts for the bare context_switch benchmark
+static CpuContext bench_main;
+static CpuContext bench_partner;
+// Keeps the yield benchmark process alive
+static volatile bool bench_running = false;
+
+// Partner side of the bare benchmark: switch straight back, forever
+static void bench_partner_loop() {
+    while (1) {
+        context_switch(&bench_partner, &bench_main);
+    }
+}
+
+// Process side of the yield benchmark
+static void bench_yield_loop() {
+    while (bench_running) {
+        process_yield();
+    }
+}
+
+// Print a per-switch cost in nanoseconds
+static void bench_print(const char* label, unsigned int ticks, unsigned int switches) {
+    char buf[16];
+    uart_puts(label);
+    process_int_to_str(switches ? timer_ticks_to_ns(ticks) / switches : 0, buf);
+    uart_puts(buf);
+    uart_puts(" ns per switch (");
+    process_int_to_str(switches, buf);
+    uart_puts(buf);
+    uart_puts(" switches)\n");
+}
+
+// Measure the cost of one context switch
+void process_benchmark() {
+    // Bare register save/restore between two contexts, with IRQs off
+    unsigned char* stack = (unsigned char*)alloc_pages(page_order(PROCESS_STACK_SIZE));
+    if (stack == NULL) {
+        uart_puts("Out of memory\n");
+        return;
+    }
+    bench_partner.sp = reinterpret_cast<unsigned long>(stack + PROCESS_STACK_SIZE);
+    bench_partner.lr = reinterpret_cast<unsigned long>(bench_partner_loop);
+    bench_partner.cpsr = CPSR_MODE_SVC | CPSR_I_BIT;
+    
+    unsigned int flags = irq_save();
+    unsigned int start = timer_read();
+    for (int i = 0; i < BENCH_SWITCHES / 2; i++) {
+        context_switch(&bench_main, &bench_partner);
+    }
+    unsigned int raw_ticks = timer_read() - start;
+    irq_restore(flags);
+    free_pages(stack, page_order(PROCESS_STACK_SIZE));
+    
+    // Full path through the scheduler, ping-ponging with a second process
+    bench_running = true;
+    if (process_create("ctxbench", bench_yield_loop, current_process->priority) < 0) {
+        bench_running = false;
+        uart_puts("Cannot create benchmark process\n");
+        return;
+    }
+    ProcessStats before = process_get_stats();
+    unsigned int switches = context_switches;
+    start = timer_read();
+    for (int i = 0; i < BENCH_SWITCHES / 2; i++) {
+        process_yield();
+    }
+    unsigned int yield_ticks = timer_read() - start;
+    switches = context_switches - switches;
+    bench_running = false;
+    
+    uart_puts("Context switch cost:\n");
+    bench_print("  context_switch:  ", raw_ticks, BENCH_SWITCHES);
+    bench_print("  process_yield:   ", yield_ticks, switches);
+    if (before.ready_processes > 2) {
+        uart_puts("  (other ready processes ran during the yield test)\n");
+    }
+}
+
+// Body of a stress test process. It never runs: stress_create leaves it
+// blocked until it is terminated.
+static void stress_loop() {
+    process_block(0);
+}
+
+// Create a stress test process blocked, as if waiting in process_block. A
+// runnable one would get the CPU under the fair class (it starts at
+// min_vruntime) and the timings would measure scheduling, not the table.
+static int stress_create(const char* name) {
+    IrqGuard guard;
+    
+    Process* process = process_alloc(name, stress_loop, 1);
+    if (process == NULL) {
+        return -1;
+    }
+    process->waiting = true;
+    process_set_state(process, PROCESS_BLOCKED);
+    return process->id;
+}
+
+// Name of the nth stress test process
+static void stress_name(unsigned int n, char* name) {
+    name[0] = 's';
+    process_int_to_str(n, name + 1);
+}
+
+// Print a row of per-operation costs
+static void stress_row(unsigned int live, unsigned int create_us, unsigned int creates, unsigned int lookup_us) {
+    process_put_column(live, "", 8);
+    process_put_column(create_us * 1000 / creates, " ns", 12);
+    process_put_column(lookup_us * 1000 / (live * 2), " ns", 12);
+    uart_puts("\n");
+}
+
+// How many more processes fit: free PIDs, and free pages for a stack and a
+// share of a PCB slab each
+unsigned int process_capacity() {
+    unsigned int pids = PROCESS_MAX_PIDS - process_live_count() - 1;
+    
+    MemoryStats mem = memory_get_stats();
+    unsigned int pcbs_per_page = PAGE_SIZE / sizeof(Process);
+    unsigned int stack_pages = 1u << page_order(PROCESS_STACK_SIZE);
+    unsigned int pages = mem.pages_free * pcbs_per_page / (stack_pages * pcbs_per_page + 1);
+    
+    return pages < pids ? pages : pids;
+}
+
+// Grow the process table to count extra processes and shrink it again,
+// timing create, lookup and terminate at each size, then churn through
+// count create/terminate pairs with the table full
+void process_stress(unsigned int count) {
+    unsigned int capacity = process_capacity();
+    if (count > capacity) {
+        count = capacity;
+    }
+    count &= ~3u;
+    if (count == 0) {
+        uart_puts("No room for more processes\n");
+        return;
+    }
+    
+    int* pids = (int*)memory_alloc(count * sizeof(int));
+    if (pids == NULL) {
+        uart_puts("Out of memory\n");
+        return;
+    }
+    
+    char name[MAX_PROCESS_NAME];
+    unsigned int step = count / 4;
+    unsigned int live = 0;
+    
+    uart_puts("Process table stress (");
+    process_int_to_str(count, name);
+    uart_puts(name);
+    uart_puts(" processes):\n");
+    uart_puts("LIVE    CREATE      LOOKUP\n");
+    
+    // Grow in four steps, looking every live one up by PID and name after each
+    for (unsigned int round = 0; round < 4; round++) {
+        unsigned int start = timer_read();
+        for (unsigned int i = 0; i < step; i++) {
+            stress_name(live, name);
+            pids[live] = stress_create(name);
+            if (pids[live] < 0) {
+                break;
+            }
+            live++;
+        }
+        unsigned int create_us = timer_ticks_to_us(timer_read() - start);
+        if (live < (round + 1) * step) {
+            uart_puts("Out of memory after ");
+            process_int_to_str(live, name);
+            uart_puts(name);
+            uart_puts(" processes\n");
+            break;
+        }
+        
+        start = timer_read();
+        for (unsigned int i = 0; i < live; i++) {
+            stress_name(i, name);
+            if (process_get_by_id(pids[i]) != process_get_by_name(name)) {
+                uart_puts("Lookup mismatch\n");
+            }
+        }
+        unsigned int lookup_us = timer_ticks_to_us(timer_read() - start);
+        stress_row(live, create_us, step, lookup_us);
+    }
+    
+    // Churn: reap and respawn with the table at its largest
+    unsigned int start = timer_read();
+    for (unsigned int i = 0; i < live; i++) {
+        process_terminate(pids[i]);
+        stress_name(i, name);
+        pids[i] = stress_create(name);
+    }
+    unsigned int churn_us = timer_ticks_to_us(timer_read() - start);
+    
+    // Shrink again
+    start = timer_read();
+    for (unsigned int i = 0; i < live; i++) {
+        process_terminate(pids[i]);
+    }
+    unsigned int terminate_us = timer_ticks_to_us(timer_read() - start);
+    memory_free(pids);
+    
+    if (live > 0) {
+        uart_puts("Churn:      ");
+        process_put_column(churn_us * 1000 / live, " ns", 12);
+        uart_puts("per terminate + create, ");
+        process_int_to_str(live, name);
+        uart_puts(name);
+        uart_puts(" times\nTerminate:  ");
+        process_put_column(terminate_us * 1000 / live, " ns", 12);
+        uart_puts("per process\n");
+    }
+}
@@ -1,12 +1,31 @@
 #ifndef PROCESS_HPP
 #define PROCESS_HPP
 
-// Maximum number of processes
-#define MAX_PROCESSES 16
+#include "ktimer.hpp"
+
+struct WaitQueue;
+struct Mutex;
+
+// Largest number of processes (PIDs run from 0 to PROCESS_MAX_PIDS - 1)
+#define PROCESS_MAX_PIDS 4096
+// Buckets in the PID and name lookup tables (chains stay a few entries long)
+#define PROCESS_PID_HASH_SIZE 1024
+#define PROCESS_NAME_HASH_SIZE 1024
 // Maximum process name length
 #define MAX_PROCESS_NAME 32
 // Size of process stack (4KB per process)
 #define PROCESS_STACK_SIZE 4096
+// Timer interrupt rate and default length of a time slice
+#define PROCESS_TICK_HZ 100
+#define PROCESS_TICK_MS (1000 / PROCESS_TICK_HZ)
+#define PROCESS_TIME_SLICE_TICKS 10
+// CPU usage is reported over the last full window of this length
+#define PROCESS_CPU_WINDOW_MS 1000
+// Share of the CPU periodic (EDF) processes may reserve, in tenths of a percent
+#define PROCESS_RT_MAX_UTILIZATION 900
+// Priority levels (higher runs first; 0 is reserved for the idle process)
+#define PROCESS_PRIORITY_LEVELS 32
+#define PROCESS_PRIORITY_MAX (PROCESS_PRIORITY_LEVELS - 1)
 
 // Process states
 enum ProcessState {
@@ -16,6 +35,20 @@ enum ProcessState {
     PROCESS_TERMINATED // Terminated
 };
 
+// Scheduling classes, chosen at boot
+enum SchedClass {
+    SCHED_PRIORITY,    // Strict priority, round-robin within a level
+    SCHED_FAIR         // Fair share of the CPU by weighted virtual runtime
+};
+
+// Registers saved across a context switch (layout is used by context.s)
+struct CpuContext {
+    unsigned int r4_r11[8];
+    unsigned int sp;
+    unsigned int lr;
+    unsigned int cpsr;
+};
+
 // Process control block structure
 struct Process {
     char name[MAX_PROCESS_NAME];
@@ -26,19 +59,80 @@ struct Process {
     unsigned int stack_size;
     unsigned int runtime_ms;
     unsigned int created_at;
+    void (*entry)();
+    CpuContext context;
+    struct Process* queue_next;   // Ready queue links
+    struct Process* queue_prev;
+    unsigned int vruntime;        // Runtime scaled by weight, in microseconds (wraps)
+    unsigned int vruntime_lent;   // Taken off vruntime by process_lend_vruntime, owed back
+    unsigned int state_since;     // Uptime when it entered its current state
+    unsigned int state_ms[PROCESS_TERMINATED];  // Time spent in each earlier live state
+    unsigned int voluntary_switches;    // Gave up the CPU (yield, block, exit)
+    unsigned int involuntary_switches;  // Preempted
+    struct Process* heap_child;   // Fair runqueue (pairing heap) links
+    struct Process* heap_sibling;
+    struct Process* heap_prev;    // Parent, or the sibling before this one
+    unsigned int rt_period_ms;    // Period of a real-time (EDF) process, 0 otherwise
+    unsigned int rt_budget_ms;    // CPU time each job may use
+    unsigned int rt_budget_left;  // Left for the current job
+    unsigned int rt_deadline;     // Uptime by which the current job must finish
+    unsigned int rt_jobs;         // Jobs completed
+    unsigned int rt_misses;       // Jobs that missed their deadline
+    bool rt_job_done;             // Current job finished; waiting for the next period
+    bool waiting;                 // Blocked in process_block
+    bool timed_out;               // Its last process_block ended by timeout
+    KTimer wait_timer;            // Timeout of process_block
+    unsigned int base_priority;   // Own priority; priority may be inherited through a mutex
+    struct WaitQueue* wait_queue; // Wait queue it is blocked on, if any
+    struct Process* wait_next;    // Wait queue links
+    struct Process* wait_prev;
+    struct Mutex* mutexes_held;   // Mutexes it owns
+    struct Process* rt_next;      // List of real-time processes
+    struct Process* all_next;     // List of all processes, in creation order
+    struct Process* all_prev;
+    struct Process* pid_next;     // PID hash chain
+    struct Process** pid_pprev;   // Link that points at this process
+    struct Process* name_next;    // Name hash chain
+    struct Process** name_pprev;
+    unsigned int name_hash;
+    unsigned int cpu_window;      // CPU window that cpu_ms belongs to
+    unsigned int cpu_ms;          // CPU time used in that window
+    unsigned int cpu_prev_ms;     // CPU time used in the window before it
 };
 
 // Process management functions
-void process_init();
+void process_init(SchedClass sched_class);
+SchedClass process_get_sched_class();
 int process_create(const char* name, void (*entry_point)(), unsigned int priority);
+int process_create_periodic(const char* name, void (*job)(), unsigned int period_ms, unsigned int budget_ms);
 void process_terminate(unsigned int pid);
+void process_exit();
 void process_schedule();
 void process_yield();
+bool process_block(unsigned int timeout_ms);
+void process_wake(Process* process);
+void process_sleep(unsigned int ms);
+void process_boost(Process* process, unsigned int priority);
+void process_lend_vruntime(Process* process, const Process* waiter);
+bool process_repay_vruntime(Process* process);
+void process_start_preemption();
 void process_dump();
 Process* process_get_current();
 Process* process_get_by_id(unsigned int pid);
 Process* process_get_by_name(const char* name);
 void process_timer_tick(unsigned int ms);
+void process_set_time_slice(unsigned int priority, unsigned int ms);
+unsigned int process_get_time_slice(unsigned int priority);
+unsigned int process_get_weight(unsigned int priority);
+unsigned int process_get_rt_utilization();
+unsigned int process_get_cpu_percent(Process* process);
+unsigned int process_get_state_time(Process* process, ProcessState state);
+void process_benchmark();
+unsigned int process_capacity();
+void process_stress(unsigned int count);
+
+// Save the current registers into from and resume to
+extern "C" void context_switch(CpuContext* from, CpuContext* to);
 
 // Process Statistics
 struct ProcessStats {
@@ -46,8 +140,23 @@ struct ProcessStats {
     unsigned int running_processes;
     unsigned int ready_processes;
     unsigned int blocked_processes;
-    unsigned int terminated_processes;
-    unsigned int cpu_usage;
+    unsigned int terminated_processes;   // Since boot
+    unsigned int cpu_usage;          // Percent busy over the last full CPU window
+    unsigned int cpu_usage_total;    // Percent busy since boot
+    unsigned int load_avg[3];        // Runnable processes over 1, 10 and 60 s, in hundredths
+    unsigned int context_switches;
+    unsigned int voluntary_switches;
+    unsigned int involuntary_switches;
+    unsigned int switch_rate;        // Context switches per second over the last CPU window
+    unsigned int rt_processes;
+    unsigned int deadline_misses;    // Since boot
+    unsigned int idle_residency;     // Percent of the last CPU window asleep in WFI
+    unsigned int idle_residency_total;   // Percent asleep since boot
+    unsigned int idle_sleeps;
+    unsigned int idle_ticks_skipped; // Tick interrupts left out while asleep
+    unsigned int wakeups;            // Sleeps that ended by switching to a process
+    unsigned int wakeup_latency_ns;  // Average from the end of a sleep to that switch
+    unsigned int wakeup_latency_max_ns;
 };
 
 ProcessStats process_get_stats();
@@ -0,0 +1,209 @@
+#include "slab.hpp"
+#include "memory.hpp"
+#include "irq.hpp"
+
+// Define NULL if not defined
+#ifndef NULL
+#define NULL 0
+#endif
+
+// Minimum number of objects a slab should hold before we use bigger slabs
+#define SLAB_MIN_OBJECTS 8
+
+// Cache descriptors
+static KmemCache caches[MAX_SLAB_CACHES];
+static unsigned int cache_count = 0;
+
+// Round value up to a multiple of align (align must be a power of two)
+static unsigned int align_up(unsigned int value, unsigned int align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+// Bytes covered by one slab of a cache
+static unsigned int slab_bytes(KmemCache* cache) {
+    return (unsigned int)PAGE_SIZE << cache->order;
+}
+
+// Push a slab onto the front of a list
+static void slab_list_push(Slab** list, Slab* slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list) {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+// Unlink a slab from a list
+static void slab_list_remove(Slab** list, Slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+// Get fresh pages and carve them into objects
+static Slab* slab_grow(KmemCache* cache) {
+    unsigned char* base = (unsigned char*)alloc_pages(cache->order);
+    if (!base) {
+        return NULL;
+    }
+    
+    Slab* slab = reinterpret_cast<Slab*>(base);
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free_objects = NULL;
+    
+    // Thread the free list so objects are handed out in address order
+    for (int i = cache->objects_per_slab - 1; i >= 0; i--) {
+        void** obj = reinterpret_cast<void**>(base + cache->first_offset + i * cache->stride);
+        *obj = slab->free_objects;
+        slab->free_objects = obj;
+    }
+    
+    cache->slab_count++;
+    return slab;
+}
+
+// Create a cache for objects of the given size and alignment
+KmemCache* kmem_cache_create(const char* name, unsigned int size, unsigned int align) {
+    if (cache_count >= MAX_SLAB_CACHES || size == 0) {
+        return NULL;
+    }
+    
+    // Objects must hold the free list link and be at least word aligned
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+    if (align & (align - 1)) {
+        // Alignment must be a power of two
+        return NULL;
+    }
+    
+    KmemCache* cache = &caches[cache_count];
+    
+    int i = 0;
+    while (name[i] && i < MAX_SLAB_NAME - 1) {
+        cache->name[i] = name[i];
+        i++;
+    }
+    cache->name[i] = '\0';
+    
+    cache->object_size = size;
+    cache->stride = align_up(size < sizeof(void*) ? sizeof(void*) : size, align);
+    cache->first_offset = align_up(sizeof(Slab), align);
+    
+    // Use the smallest slab that holds a reasonable number of objects
+    cache->order = 0;
+    while (cache->order < PAGE_MAX_ORDER &&
+           (slab_bytes(cache) - cache->first_offset) / cache->stride < SLAB_MIN_OBJECTS) {
+        cache->order++;
+    }
+    if (slab_bytes(cache) < cache->first_offset + cache->stride) {
+        // Object too large for the page allocator
+        return NULL;
+    }
+    cache->objects_per_slab = (slab_bytes(cache) - cache->first_offset) / cache->stride;
+    
+    cache->partial = NULL;
+    cache->full = NULL;
+    cache->empty = NULL;
+    cache->slab_count = 0;
+    cache->active_objects = 0;
+    
+    cache_count++;
+    return cache;
+}
+
+// Allocate one object from a cache
+void* kmem_cache_alloc(KmemCache* cache) {
+    IrqGuard guard;
+    
+    // Prefer partially used slabs, then the cached empty one, then new pages
+    Slab* slab = cache->partial;
+    if (!slab) {
+        slab = cache->empty;
+        if (slab) {
+            slab_list_remove(&cache->empty, slab);
+        } else {
+            slab = slab_grow(cache);
+            if (!slab) {
+                return NULL;
+            }
+        }
+        slab_list_push(&cache->partial, slab);
+    }
+    
+    void** obj = reinterpret_cast<void**>(slab->free_objects);
+    slab->free_objects = *obj;
+    slab->inuse++;
+    cache->active_objects++;
+    
+    if (slab->inuse == cache->objects_per_slab) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+    
+    return obj;
+}
+
+// Return an object to its cache
+void kmem_cache_free(KmemCache* cache, void* obj) {
+    IrqGuard guard;
+    
+    if (!obj) return;
+    
+    // Slabs are naturally aligned buddy blocks, so the header is found by masking
+    unsigned long mask = ~((unsigned long)slab_bytes(cache) - 1);
+    Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<unsigned long>(obj) & mask);
+    
+    if (slab->inuse == cache->objects_per_slab) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
+    }
+    
+    *reinterpret_cast<void**>(obj) = slab->free_objects;
+    slab->free_objects = obj;
+    slab->inuse--;
+    cache->active_objects--;
+    
+    if (slab->inuse == 0) {
+        slab_list_remove(&cache->partial, slab);
+        
+        // Keep one empty slab around to absorb alloc/free churn
+        if (cache->empty == NULL) {
+            slab_list_push(&cache->empty, slab);
+        } else {
+            free_pages(slab, cache->order);
+            cache->slab_count--;
+        }
+    }
+}
+
+// Get the number of caches
+unsigned int kmem_cache_count() {
+    return cache_count;
+}
+
+// Get utilization statistics for one cache
+bool kmem_cache_get_stats(unsigned int index, SlabStats* stats) {
+    if (index >= cache_count) {
+        return false;
+    }
+    
+    KmemCache* cache = &caches[index];
+    stats->name = cache->name;
+    stats->object_size = cache->object_size;
+    stats->objects_per_slab = cache->objects_per_slab;
+    stats->slab_count = cache->slab_count;
+    stats->active_objects = cache->active_objects;
+    stats->total_objects = cache->slab_count * cache->objects_per_slab;
+    stats->slab_bytes = cache->slab_count * slab_bytes(cache);
+    stats->waste_bytes = stats->slab_bytes - cache->slab_count * cache->objects_per_slab * cache->object_size;
+    
+    return true;
+}
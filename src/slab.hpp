@@ -0,0 +1,53 @@
+#ifndef SLAB_HPP
+#define SLAB_HPP
+
+// Maximum number of object caches
+#define MAX_SLAB_CACHES 16
+// Maximum cache name length
+#define MAX_SLAB_NAME 16
+
+// Slab header, stored at the start of each slab's pages
+struct Slab {
+    struct KmemCache* cache;
+    Slab* next;
+    Slab* prev;
+    void* free_objects;        // Singly linked through the first word of each free object
+    unsigned int inuse;
+};
+
+// Object cache for one fixed-size object type
+struct KmemCache {
+    char name[MAX_SLAB_NAME];
+    unsigned int object_size;      // Size requested by the creator
+    unsigned int stride;           // Object size rounded up to the alignment
+    unsigned int first_offset;     // Offset of the first object from the slab start
+    unsigned int objects_per_slab;
+    unsigned int order;            // Page order of each slab
+    Slab* partial;                 // Slabs with both free and used objects
+    Slab* full;                    // Slabs with no free objects
+    Slab* empty;                   // Slabs with no used objects
+    unsigned int slab_count;
+    unsigned int active_objects;
+};
+
+// Slab allocator functions
+KmemCache* kmem_cache_create(const char* name, unsigned int size, unsigned int align);
+void* kmem_cache_alloc(KmemCache* cache);
+void kmem_cache_free(KmemCache* cache, void* obj);
+
+// Slab Statistics
+struct SlabStats {
+    const char* name;
+    unsigned int object_size;
+    unsigned int objects_per_slab;
+    unsigned int slab_count;
+    unsigned int active_objects;
+    unsigned int total_objects;
+    unsigned int slab_bytes;      // Memory held by all slabs
+    unsigned int waste_bytes;     // Headers, padding and unused tail space in all slabs
+};
+
+unsigned int kmem_cache_count();
+bool kmem_cache_get_stats(unsigned int index, SlabStats* stats);
+
+#endif // SLAB_HPP
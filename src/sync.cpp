@@ -0,0 +1,567 @@
+#include "sync.hpp"
+#include "process.hpp"
+#include "timer.hpp"
+#include "irq.hpp"
+#include "uart.hpp"
+#include "kstring.hpp"
+
+/*
+ * Wait queues, semaphores and mutexes
+ * A blocked process sits on one wait queue, ordered by priority, and is
+ * PROCESS_BLOCKED until a waker takes it off the queue. Semaphores and
+ * mutexes hand the unit or the lock straight to the process they wake, so
+ * nobody can barge in before it runs. A mutex owner runs at the priority of
+ * its highest waiter, passed along chains of owners waiting on other mutexes.
+ */
+
+// Forward declarations
+void int_to_str(unsigned int num, char* str);
+
+// Define NULL if not defined
+#ifndef NULL
+#define NULL 0
+#endif
+
+// Semaphore round trips in the benchmark
+#define BENCH_ROUND_TRIPS 1000
+
+// Every initialized wait queue, for sync_dump
+static WaitQueue* queue_list = NULL;
+
+// Put a process on a queue behind those of equal or higher priority
+static void waitqueue_insert(WaitQueue* queue, Process* process) {
+    Process* prev = queue->tail;
+    while (prev != NULL && prev->priority < process->priority) {
+        prev = prev->wait_prev;
+    }
+    
+    process->wait_prev = prev;
+    process->wait_next = prev != NULL ? prev->wait_next : queue->head;
+    if (process->wait_next != NULL) {
+        process->wait_next->wait_prev = process;
+    } else {
+        queue->tail = process;
+    }
+    if (prev != NULL) {
+        prev->wait_next = process;
+    } else {
+        queue->head = process;
+    }
+    
+    process->wait_queue = queue;
+    queue->waiting++;
+}
+
+// Take a process off the queue it is on
+static void waitqueue_unlink(WaitQueue* queue, Process* process) {
+    if (process->wait_prev != NULL) {
+        process->wait_prev->wait_next = process->wait_next;
+    } else {
+        queue->head = process->wait_next;
+    }
+    if (process->wait_next != NULL) {
+        process->wait_next->wait_prev = process->wait_prev;
+    } else {
+        queue->tail = process->wait_prev;
+    }
+    
+    process->wait_next = NULL;
+    process->wait_prev = NULL;
+    process->wait_queue = NULL;
+    queue->waiting--;
+}
+
+// Priority a process should run at: its own, or that of the first waiter
+// of any mutex it holds if that is higher
+static unsigned int pi_priority(Process* process) {
+    unsigned int priority = process->base_priority;
+    for (Mutex* mutex = process->mutexes_held; mutex != NULL; mutex = mutex->held_next) {
+        Process* top = mutex->queue.head;
+        if (top != NULL && top->priority > priority) {
+            priority = top->priority;
+        }
+    }
+    return priority;
+}
+
+// Bring a mutex owner to the priority it should have. If it is waiting on
+// another mutex itself, its place in that queue and the owner of that one
+// change too, and so on down the chain.
+static void pi_update(Process* process) {
+    for (int depth = 0; process != NULL && depth < SYNC_PI_MAX_DEPTH; depth++) {
+        unsigned int priority = pi_priority(process);
+        if (priority == process->priority) {
+            return;
+        }
+        process_boost(process, priority);
+        
+        WaitQueue* queue = process->wait_queue;
+        if (queue == NULL) {
+            return;
+        }
+        waitqueue_unlink(queue, process);
+        waitqueue_insert(queue, process);
+        process = queue->mutex != NULL ? queue->mutex->owner : NULL;
+    }
+}
+
+// Under the fair class, also move every owner down the chain from a new
+// waiter to the front of the runqueue (see process_lend_vruntime)
+static void pi_lend(Process* waiter, Mutex* mutex) {
+    for (int depth = 0; mutex != NULL && mutex->owner != NULL && depth < SYNC_PI_MAX_DEPTH; depth++) {
+        Process* owner = mutex->owner;
+        process_lend_vruntime(owner, waiter);
+        mutex = owner->wait_queue != NULL ? owner->wait_queue->mutex : NULL;
+    }
+}
+
+// Set up an empty queue and make it visible to sync_dump
+void waitqueue_init(WaitQueue* queue, const char* name) {
+    IrqGuard guard;
+    
+    queue->name = name;
+    queue->kind = SYNC_WAITQUEUE;
+    queue->mutex = NULL;
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->waiting = 0;
+    queue->acquired = 0;
+    queue->waits = 0;
+    queue->timeouts = 0;
+    queue->wait_us = 0;
+    queue->max_wait_us = 0;
+    
+    queue->all_prev = NULL;
+    queue->all_next = queue_list;
+    if (queue_list != NULL) {
+        queue_list->all_prev = queue;
+    }
+    queue_list = queue;
+}
+
+// Forget a queue nobody waits on any more
+void waitqueue_destroy(WaitQueue* queue) {
+    IrqGuard guard;
+    
+    if (queue->all_prev != NULL) {
+        queue->all_prev->all_next = queue->all_next;
+    } else {
+        queue_list = queue->all_next;
+    }
+    if (queue->all_next != NULL) {
+        queue->all_next->all_prev = queue->all_prev;
+    }
+}
+
+// Block the calling process on a queue until a waker takes it off, or the
+// timeout passes. Returns false on timeout.
+bool waitqueue_wait(WaitQueue* queue, unsigned int timeout_ms) {
+    IrqGuard guard;
+    
+    Process* current = process_get_current();
+    waitqueue_insert(queue, current);
+    queue->waits++;
+    if (queue->mutex != NULL) {
+        pi_update(queue->mutex->owner);
+        pi_lend(current, queue->mutex);
+    }
+    
+    unsigned int start = timer_read();
+    bool timed_out = false;
+    while (current->wait_queue == queue && !timed_out) {
+        timed_out = !process_block(timeout_ms);
+    }
+    
+    unsigned int us = timer_ticks_to_us(timer_read() - start);
+    queue->wait_us += us;
+    if (us > queue->max_wait_us) {
+        queue->max_wait_us = us;
+    }
+    
+    // Still queued: the timeout came first and nothing was handed over
+    if (current->wait_queue == queue) {
+        waitqueue_unlink(queue, current);
+        queue->timeouts++;
+        if (queue->mutex != NULL) {
+            pi_update(queue->mutex->owner);
+        }
+        return false;
+    }
+    return true;
+}
+
+// Wake the first process on a queue. Returns it, or NULL if there was none.
+Process* waitqueue_wake_one(WaitQueue* queue) {
+    IrqGuard guard;
+    
+    Process* process = queue->head;
+    if (process != NULL) {
+        waitqueue_unlink(queue, process);
+        process_wake(process);
+    }
+    return process;
+}
+
+// Wake every process on a queue. Returns how many there were.
+unsigned int waitqueue_wake_all(WaitQueue* queue) {
+    IrqGuard guard;
+    
+    unsigned int woken = 0;
+    while (waitqueue_wake_one(queue) != NULL) {
+        woken++;
+    }
+    return woken;
+}
+
+// Set up a semaphore with count units
+void semaphore_init(Semaphore* sem, const char* name, unsigned int count) {
+    waitqueue_init(&sem->queue, name);
+    sem->queue.kind = SYNC_SEMAPHORE;
+    sem->count = count;
+}
+
+// Forget a semaphore nobody waits on any more
+void semaphore_destroy(Semaphore* sem) {
+    waitqueue_destroy(&sem->queue);
+}
+
+// Take a unit, blocking until one is handed over or the timeout passes
+bool semaphore_down(Semaphore* sem, unsigned int timeout_ms) {
+    IrqGuard guard;
+    
+    if (sem->count > 0) {
+        sem->count--;
+        sem->queue.acquired++;
+        return true;
+    }
+    return waitqueue_wait(&sem->queue, timeout_ms);
+}
+
+// Take a unit if one is free
+bool semaphore_try_down(Semaphore* sem) {
+    IrqGuard guard;
+    
+    if (sem->count == 0) {
+        return false;
+    }
+    sem->count--;
+    sem->queue.acquired++;
+    return true;
+}
+
+// Give back a unit. A waiter gets it directly instead of the count.
+void semaphore_up(Semaphore* sem) {
+    IrqGuard guard;
+    
+    if (sem->queue.head != NULL) {
+        sem->queue.acquired++;
+        waitqueue_wake_one(&sem->queue);
+    } else {
+        sem->count++;
+    }
+}
+
+// Set up an unlocked mutex
+void mutex_init(Mutex* mutex, const char* name) {
+    waitqueue_init(&mutex->queue, name);
+    mutex->queue.kind = SYNC_MUTEX;
+    mutex->queue.mutex = mutex;
+    mutex->owner = NULL;
+    mutex->held_next = NULL;
+}
+
+// Forget an unlocked mutex nobody waits on any more
+void mutex_destroy(Mutex* mutex) {
+    waitqueue_destroy(&mutex->queue);
+}
+
+// Make a process the owner of a mutex
+static void mutex_take(Mutex* mutex, Process* process) {
+    mutex->owner = process;
+    mutex->held_next = process->mutexes_held;
+    process->mutexes_held = mutex;
+    mutex->queue.acquired++;
+}
+
+// Pass a mutex from its owner to the first waiter, or leave it unlocked.
+// Returns the new owner, which still has to be woken.
+static Process* mutex_hand_off(Mutex* mutex) {
+    Process* owner = mutex->owner;
+    Mutex** link = &owner->mutexes_held;
+    while (*link != mutex) {
+        link = &(*link)->held_next;
+    }
+    *link = mutex->held_next;
+    mutex->held_next = NULL;
+    mutex->owner = NULL;
+    
+    Process* next = mutex->queue.head;
+    if (next != NULL) {
+        waitqueue_unlink(&mutex->queue, next);
+        mutex_take(mutex, next);
+        
+        // It takes over the boost from those still waiting
+        pi_update(next);
+    }
+    return next;
+}
+
+// Lock a mutex, blocking until it is handed over or the timeout passes.
+// While blocked, the owner runs at least at the caller's priority.
+bool mutex_lock(Mutex* mutex, unsigned int timeout_ms) {
+    IrqGuard guard;
+    
+    Process* current = process_get_current();
+    if (mutex->owner == NULL) {
+        mutex_take(mutex, current);
+        return true;
+    }
+    if (mutex->owner == current) {
+        return false;
+    }
+    return waitqueue_wait(&mutex->queue, timeout_ms);
+}
+
+// Lock a mutex if it is free
+bool mutex_try_lock(Mutex* mutex) {
+    IrqGuard guard;
+    
+    if (mutex->owner != NULL) {
+        return false;
+    }
+    mutex_take(mutex, process_get_current());
+    return true;
+}
+
+// Unlock a mutex held by the caller, handing it to the first waiter
+void mutex_unlock(Mutex* mutex) {
+    IrqGuard guard;
+    
+    Process* current = process_get_current();
+    if (mutex->owner != current) {
+        return;
+    }
+    
+    Process* next = mutex_hand_off(mutex);
+    
+    // Drop any priority inherited through this mutex, and once no mutex is
+    // left pay back any vruntime lent. Someone else may have to run now
+    // even if the new owner does not preempt.
+    bool reschedule = pi_priority(current) < current->priority;
+    pi_update(current);
+    if (current->mutexes_held == NULL && process_repay_vruntime(current)) {
+        reschedule = true;
+    }
+    
+    if (next != NULL) {
+        process_wake(next);
+    }
+    if (reschedule) {
+        process_schedule();
+    }
+}
+
+// A process is going away: take it off any queue and pass on its mutexes
+void sync_process_exit(Process* process) {
+    IrqGuard guard;
+    
+    WaitQueue* queue = process->wait_queue;
+    if (queue != NULL) {
+        waitqueue_unlink(queue, process);
+        if (queue->mutex != NULL) {
+            pi_update(queue->mutex->owner);
+        }
+    }
+    
+    while (process->mutexes_held != NULL) {
+        Process* next = mutex_hand_off(process->mutexes_held);
+        if (next != NULL) {
+            process_wake(next);
+        }
+    }
+}
+
+// Print a value, padded with spaces to a column width
+static void sync_put_column(const char* text, int width) {
+    uart_puts(text);
+    width -= strlen(text);
+    while (width-- > 0) {
+        uart_putc(' ');
+    }
+}
+
+// Print a number with a unit, padded with spaces to a column width
+static void sync_put_number(unsigned int value, const char* unit, int width) {
+    char buf[24];
+    int_to_str(value, buf);
+    strcat(buf, unit);
+    sync_put_column(buf, width);
+}
+
+// List every wait queue, semaphore and mutex with its contention counters
+void sync_dump() {
+    static const char* kinds[] = { "queue", "semaphore", "mutex" };
+    char buf[16];
+    IrqGuard guard;
+    
+    uart_puts("Wait queues, semaphores and mutexes:\n");
+    uart_puts("NAME            KIND       ACQUIRED  WAITS     TIMEOUTS  WAIT TOTAL  WAIT MAX    STATE\n");
+    for (WaitQueue* queue = queue_list; queue != NULL; queue = queue->all_next) {
+        sync_put_column(queue->name, 16);
+        sync_put_column(kinds[queue->kind], 11);
+        sync_put_number(queue->acquired, "", 10);
+        sync_put_number(queue->waits, "", 10);
+        sync_put_number(queue->timeouts, "", 10);
+        sync_put_number(queue->wait_us / 1000, " ms", 12);
+        sync_put_number(queue->max_wait_us, " us", 12);
+        
+        if (queue->kind == SYNC_MUTEX) {
+            Process* owner = queue->mutex->owner;
+            if (owner != NULL) {
+                uart_puts("held by ");
+                int_to_str(owner->id, buf);
+                uart_puts(buf);
+            } else {
+                uart_puts("free");
+            }
+        } else if (queue->kind == SYNC_SEMAPHORE) {
+            uart_puts("count ");
+            int_to_str(((Semaphore*)queue)->count, buf);
+            uart_puts(buf);
+        }
+        if (queue->waiting != 0) {
+            uart_puts(", ");
+            int_to_str(queue->waiting, buf);
+            uart_puts(buf);
+            uart_puts(" waiting");
+        }
+        uart_puts("\n");
+    }
+}
+
+// Benchmark objects, set up on first use and kept for sync_dump
+static bool bench_ready = false;
+static Semaphore bench_ping;
+static Semaphore bench_pong;
+static Semaphore bench_done;
+static Mutex bench_mutex;
+// Results of the inversion test
+static unsigned int bench_low_priority = 0;
+static unsigned int bench_high_wait_us = 0;
+
+// Stay busy for a while
+static void bench_spin(unsigned int us) {
+    unsigned int start = timer_read();
+    while (timer_ticks_to_us(timer_read() - start) < us) {
+        // Busy work
+    }
+}
+
+// Partner of the round trip test: answer every ping with a pong
+static void bench_pong_loop() {
+    for (int i = 0; i < BENCH_ROUND_TRIPS; i++) {
+        semaphore_down(&bench_ping, 0);
+        semaphore_up(&bench_pong);
+    }
+}
+
+// Low-priority holder of the mutex in the inversion test. Notes the
+// highest priority it ran at while holding it.
+static void bench_low() {
+    mutex_lock(&bench_mutex, 0);
+    semaphore_up(&bench_done);
+    for (int i = 0; i < 30; i++) {
+        bench_spin(1000);
+        if (process_get_current()->priority > bench_low_priority) {
+            bench_low_priority = process_get_current()->priority;
+        }
+    }
+    mutex_unlock(&bench_mutex);
+    semaphore_up(&bench_done);
+}
+
+// Medium-priority process that wants the CPU for a long time
+static void bench_medium() {
+    bench_spin(100000);
+    semaphore_up(&bench_done);
+}
+
+// High-priority process that needs the mutex shortly after it starts
+static void bench_high() {
+    process_sleep(5);
+    unsigned int start = timer_read();
+    mutex_lock(&bench_mutex, 0);
+    bench_high_wait_us = timer_ticks_to_us(timer_read() - start);
+    mutex_unlock(&bench_mutex);
+    semaphore_up(&bench_done);
+}
+
+// Time semaphore round trips between two processes, then set up a
+// priority inversion and see how long the high-priority process waits
+void sync_benchmark() {
+    char buf[16];
+    
+    if (!bench_ready) {
+        semaphore_init(&bench_ping, "bench_ping", 0);
+        semaphore_init(&bench_pong, "bench_pong", 0);
+        semaphore_init(&bench_done, "bench_done", 0);
+        mutex_init(&bench_mutex, "bench_mutex");
+        bench_ready = true;
+    }
+    
+    // Round trips: each one blocks and wakes both sides once
+    unsigned int priority = process_get_current()->priority;
+    if (process_create("syncpong", bench_pong_loop, priority) < 0) {
+        uart_puts("Cannot create benchmark process\n");
+        return;
+    }
+    unsigned int start = timer_read();
+    for (int i = 0; i < BENCH_ROUND_TRIPS; i++) {
+        semaphore_up(&bench_ping);
+        semaphore_down(&bench_pong, 0);
+    }
+    unsigned int trip_ticks = timer_read() - start;
+    
+    uart_puts("Synchronization benchmark:\n");
+    uart_puts("  Semaphore round trip:  ");
+    int_to_str(timer_ticks_to_ns(trip_ticks) / BENCH_ROUND_TRIPS, buf);
+    uart_puts(buf);
+    uart_puts(" ns (");
+    int_to_str(BENCH_ROUND_TRIPS, buf);
+    uart_puts(buf);
+    uart_puts(" trips, two hand-offs each)\n");
+    
+    // Inversion: low holds the mutex, medium hogs the CPU, high blocks on
+    // the mutex. Without inheritance high waits for medium to finish.
+    bench_low_priority = 0;
+    bench_high_wait_us = 0;
+    unsigned int low = priority > 1 ? priority - 1 : 1;
+    if (process_create("synclow", bench_low, low) < 0) {
+        uart_puts("Cannot create benchmark process\n");
+        return;
+    }
+    if (!semaphore_down(&bench_done, 1000)) {
+        uart_puts("  Low-priority process did not get the mutex\n");
+        return;
+    }
+    int created = 0;
+    created += process_create("synchigh", bench_high, priority + 10) >= 0;
+    created += process_create("syncmed", bench_medium, priority + 5) >= 0;
+    for (int i = 0; i < created + 1; i++) {
+        semaphore_down(&bench_done, 2000);
+    }
+    
+    uart_puts("  Priority inversion:    high waited ");
+    int_to_str(bench_high_wait_us / 1000, buf);
+    uart_puts(buf);
+    uart_puts(" ms for a mutex held 30 ms (medium spins 100 ms)\n");
+    uart_puts("  Holder ran at priority ");
+    int_to_str(bench_low_priority, buf);
+    uart_puts(buf);
+    uart_puts(" (its own is ");
+    int_to_str(low, buf);
+    uart_puts(buf);
+    uart_puts(")\n\n");
+    
+    sync_dump();
+}
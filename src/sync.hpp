@@ -0,0 +1,74 @@
+#ifndef SYNC_HPP
+#define SYNC_HPP
+
+#include "process.hpp"
+
+// Longest chain of mutex owners a priority boost is passed along
+#define SYNC_PI_MAX_DEPTH 8
+
+// What a wait queue belongs to
+enum SyncKind {
+    SYNC_WAITQUEUE,
+    SYNC_SEMAPHORE,
+    SYNC_MUTEX
+};
+
+// Processes blocked on something, highest priority first and in arrival
+// order within a priority. Every queue keeps its own contention counters.
+struct WaitQueue {
+    const char* name;
+    SyncKind kind;
+    struct Mutex* mutex;          // Mutex whose owner inherits the waiters' priority
+    Process* head;                // Linked through Process::wait_next
+    Process* tail;
+    unsigned int waiting;         // Blocked right now
+    unsigned int acquired;        // Semaphore downs or mutex locks that succeeded
+    unsigned int waits;           // Times a process had to block
+    unsigned int timeouts;
+    unsigned int wait_us;         // Total time blocked (wraps after ~71 minutes)
+    unsigned int max_wait_us;
+    WaitQueue* all_next;          // List of all queues, for sync_dump
+    WaitQueue* all_prev;
+};
+
+// Counting semaphore. semaphore_up hands its unit straight to the first waiter.
+struct Semaphore {
+    WaitQueue queue;
+    unsigned int count;
+};
+
+// Mutex with priority inheritance. Unlocking hands it straight to the first waiter.
+struct Mutex {
+    WaitQueue queue;
+    Process* owner;
+    Mutex* held_next;             // Other mutexes held by the owner
+};
+
+// Wait queues. A timeout of 0 waits forever; waiting returns false on timeout.
+void waitqueue_init(WaitQueue* queue, const char* name);
+void waitqueue_destroy(WaitQueue* queue);
+bool waitqueue_wait(WaitQueue* queue, unsigned int timeout_ms);
+Process* waitqueue_wake_one(WaitQueue* queue);
+unsigned int waitqueue_wake_all(WaitQueue* queue);
+
+// Semaphores. semaphore_up may be called from interrupt handlers.
+void semaphore_init(Semaphore* sem, const char* name, unsigned int count);
+void semaphore_destroy(Semaphore* sem);
+bool semaphore_down(Semaphore* sem, unsigned int timeout_ms);
+bool semaphore_try_down(Semaphore* sem);
+void semaphore_up(Semaphore* sem);
+
+// Mutexes. Locking a mutex the caller already holds fails.
+void mutex_init(Mutex* mutex, const char* name);
+void mutex_destroy(Mutex* mutex);
+bool mutex_lock(Mutex* mutex, unsigned int timeout_ms);
+bool mutex_try_lock(Mutex* mutex);
+void mutex_unlock(Mutex* mutex);
+
+// Called by process_terminate: leave any queue, hand on any mutex held
+void sync_process_exit(Process* process);
+
+void sync_dump();
+void sync_benchmark();
+
+#endif // SYNC_HPP
@@ -0,0 +1,138 @@
+#include "timer.hpp"
+#include "irq.hpp"
+
+/*
+ * Time source for QEMU/VersatilePB
+ * The system controller exposes a free-running 24 MHz counter (SYS_24MHZ)
+ * that needs no setup and wraps roughly every 179 seconds. Periodic
+ * interrupts come from SP804 timer 0, clocked at 1 MHz.
+ */
+
+// Base physical address of the system controller registers
+#define SYSCTRL_BASE    0x10000000
+
+// Register offsets from base address
+#define SYS_24MHZ       0x5C   // 24 MHz counter
+
+// SP810 system controller (timer clock selection)
+#define SCCTRL_BASE     0x101E0000
+#define SCCTRL_TIMER0_1MHZ (1 << 15)  // TIMCLK instead of the 32 kHz REFCLK
+
+// SP804 dual timer (timer 0)
+#define SP804_BASE      0x101E2000
+#define SP804_LOAD      0x00   // Reload value
+#define SP804_VALUE     0x04   // Current value
+#define SP804_CONTROL   0x08   // Control
+#define SP804_INTCLR    0x0C   // Interrupt clear
+#define SP804_RIS       0x10   // Raw interrupt status
+#define SP804_BGLOAD    0x18   // Reload value, without restarting the count
+
+// SP804 control bits
+#define SP804_32BIT     (1 << 1)
+#define SP804_INTEN     (1 << 5)
+#define SP804_PERIODIC  (1 << 6)
+#define SP804_ENABLE    (1 << 7)
+
+// Timer 0 input clock
+#define SP804_CLOCK_HZ  1000000
+
+// Helper macros for register access
+#define SYSCTRL_REG(offset) (*(volatile unsigned int*)(SYSCTRL_BASE + (offset)))
+#define SP804_REG(offset) (*(volatile unsigned int*)(SP804_BASE + (offset)))
+
+// Periodic tick handler and count
+static void (*tick_handler)() = 0;
+static unsigned int ticks = 0;
+// Timer 0 counts per tick, and the deferred count while ticks are skipped
+static unsigned int tick_period = 0;
+static unsigned int deferred_load = 0;
+static unsigned int deferred_ticks = 0;
+
+// Read the raw counter (differences are wrap-safe with unsigned arithmetic)
+unsigned int timer_read() {
+    return SYSCTRL_REG(SYS_24MHZ);
+}
+
+// Convert a tick delta to microseconds
+unsigned int timer_ticks_to_us(unsigned int ticks) {
+    return ticks / TIMER_TICKS_PER_US;
+}
+
+// Convert a tick delta to nanoseconds
+unsigned int timer_ticks_to_ns(unsigned int ticks) {
+    // Split to avoid overflowing 32 bits for deltas above ~178 ms
+    return (ticks / TIMER_TICKS_PER_US) * 1000 +
+           ((ticks % TIMER_TICKS_PER_US) * 1000) / TIMER_TICKS_PER_US;
+}
+
+// Timer 0 interrupt
+static void timer_tick_irq() {
+    SP804_REG(SP804_INTCLR) = 1;
+    ticks++;
+    if (tick_handler) {
+        tick_handler();
+    }
+}
+
+// Start a periodic interrupt at hz, calling handler from each one
+void timer_tick_start(unsigned int hz, void (*handler)()) {
+    tick_handler = handler;
+    
+    *(volatile unsigned int*)SCCTRL_BASE |= SCCTRL_TIMER0_1MHZ;
+    tick_period = SP804_CLOCK_HZ / hz;
+    SP804_REG(SP804_CONTROL) = 0;
+    SP804_REG(SP804_LOAD) = tick_period;
+    SP804_REG(SP804_INTCLR) = 1;
+    SP804_REG(SP804_CONTROL) = SP804_ENABLE | SP804_PERIODIC | SP804_INTEN | SP804_32BIT;
+    
+    irq_register(IRQ_TIMER01, timer_tick_irq);
+}
+
+// Number of periodic ticks since timer_tick_start
+unsigned int timer_tick_count() {
+    return ticks;
+}
+
+// Let the next tick interrupt come at the end of the given number of tick
+// periods instead of the current one. The counter is restarted from what is
+// left of this period plus the skipped ones, so ticks keep their phase, and
+// reloads a single period afterwards. Call with IRQs disabled.
+void timer_tick_defer(unsigned int ticks) {
+    if (tick_period == 0 || ticks <= 1 || deferred_ticks != 0) return;
+    
+    // A tick that is already due is not deferred
+    if (SP804_REG(SP804_RIS) & 1) return;
+    
+    unsigned int left = SP804_REG(SP804_VALUE);
+    deferred_load = left + (ticks - 1) * tick_period;
+    deferred_ticks = ticks;
+    SP804_REG(SP804_LOAD) = deferred_load;
+    SP804_REG(SP804_BGLOAD) = tick_period;
+}
+
+// Go back to one interrupt per tick after timer_tick_defer. Returns the tick
+// periods that ended without an interrupt; a tick whose interrupt is pending
+// is left to the interrupt handler. Call with IRQs disabled.
+unsigned int timer_tick_resume() {
+    if (deferred_ticks == 0) return 0;
+    
+    unsigned int skipped;
+    unsigned int left = SP804_REG(SP804_VALUE);
+    if ((SP804_REG(SP804_RIS) & 1) || left == 0) {
+        // Ran to the end; the counter has already reloaded a single period
+        skipped = deferred_ticks - 1;
+    } else {
+        // Woken early: count the tick boundaries passed so far and restart
+        // the counter at the next one
+        unsigned int first = deferred_load - (deferred_ticks - 1) * tick_period;
+        unsigned int elapsed = deferred_load - left;
+        skipped = elapsed < first ? 0 : 1 + (elapsed - first) / tick_period;
+        unsigned int next = left % tick_period;
+        SP804_REG(SP804_LOAD) = next ? next : tick_period;
+        SP804_REG(SP804_BGLOAD) = tick_period;
+    }
+    
+    deferred_ticks = 0;
+    ticks += skipped;
+    return skipped;
+}
@@ -0,0 +1,20 @@
+#ifndef TIMER_HPP
+#define TIMER_HPP
+
+// Frequency of the free-running system counter
+#define TIMER_TICKS_PER_US 24
+
+// Timer functions
+unsigned int timer_read();
+unsigned int timer_ticks_to_us(unsigned int ticks);
+unsigned int timer_ticks_to_ns(unsigned int ticks);
+
+// Periodic tick interrupt
+void timer_tick_start(unsigned int hz, void (*handler)());
+unsigned int timer_tick_count();
+
+// Tickless idle: skip tick interrupts, then account the ticks that were skipped
+void timer_tick_defer(unsigned int ticks);
+unsigned int timer_tick_resume();
+
+#endif // TIMER_HPP
@@ -39,6 +39,13 @@
 #define LCRH_PEN        (1 << 1)   // Parity enable
 #define LCRH_BRK        (1 << 0)   // Send break
 
+// Interrupt bits (IMSC, RIS, MIS, ICR)
+#define INT_RX          (1 << 4)   // Receive FIFO at its trigger level
+#define INT_RT          (1 << 6)   // Receive timeout, data left in the FIFO
+
+// DMA Control Register bits
+#define DMACR_TXDMAE    (1 << 1)   // Transmit DMA enable
+
 // Control Register bits
 #define CR_UARTEN       (1 << 0)   // UART enable
 #define CR_TXE          (1 << 8)   // Transmit enable
@@ -78,8 +85,16 @@ void uart_init() {
     UART_REG(UART_CR) = CR_UARTEN | CR_TXE | CR_RXE;
 }
 
-// Send a character
-void uart_putc(char c) {
+// Output capture buffer (see uart_capture_begin)
+static char* capture_buf = 0;
+static unsigned int capture_size = 0;
+static unsigned int capture_len = 0;
+
+// Called by uart_getc while the receive FIFO is empty (see uart_set_rx_wait)
+static void (*rx_wait)() = 0;
+
+// Write a character straight to the transmit FIFO
+static void uart_tx(char c) {
     // Wait until there is space in the transmit FIFO
     while (UART_REG(UART_FR) & FR_TXFF);
     
@@ -87,6 +102,23 @@ void uart_putc(char c) {
     UART_REG(UART_DR) = c;
 }
 
+// Send a character
+void uart_putc(char c) {
+    if (capture_buf) {
+        // Send what was captured so far when the buffer fills up
+        if (capture_len == capture_size) {
+            for (unsigned int i = 0; i < capture_len; i++) {
+                uart_tx(capture_buf[i]);
+            }
+            capture_len = 0;
+        }
+        capture_buf[capture_len++] = c;
+        return;
+    }
+    
+    uart_tx(c);
+}
+
 // Get a character
 char uart_getc() {
     // Wait until there is data in the receive FIFO
@@ -95,6 +127,11 @@ char uart_getc() {
         if (UART_REG(UART_RSR)) {
             UART_REG(UART_RSR) = 0; // Clear errors
         }
+        
+        // Sleep instead of spinning if someone knows how
+        if (rx_wait) {
+            rx_wait();
+        }
     }
     
     // Read and return the received character
@@ -103,9 +140,60 @@ char uart_getc() {
     return c;
 }
 
+// Whether a received character is waiting
+bool uart_rx_ready() {
+    return !(UART_REG(UART_FR) & FR_RXFE);
+}
+
+// Raise the UART interrupt while received data is waiting. The interrupt is
+// level triggered: it stays asserted until the FIFO is read or it is masked.
+void uart_rx_interrupt(bool enable) {
+    if (enable) {
+        UART_REG(UART_IMSC) |= INT_RX | INT_RT;
+    } else {
+        UART_REG(UART_IMSC) &= ~(INT_RX | INT_RT);
+        UART_REG(UART_ICR) = INT_RX | INT_RT;
+    }
+}
+
+// Let uart_getc block in wait() rather than poll; wait() returns once
+// input may have arrived
+void uart_set_rx_wait(void (*wait)()) {
+    rx_wait = wait;
+}
+
 // Output a string
 void uart_puts(const char* str) {
     while (*str) {
         uart_putc(*str++);
     }
 }
+
+// Collect output in buf instead of sending it, so it can be written in one go
+void uart_capture_begin(char* buf, unsigned int size) {
+    capture_buf = buf;
+    capture_size = size;
+    capture_len = 0;
+}
+
+// Stop capturing and return the number of bytes left in the buffer
+unsigned int uart_capture_end() {
+    capture_buf = 0;
+    return capture_len;
+}
+
+// Address of the data register, for DMA transfers
+unsigned int uart_dma_address() {
+    return UART0_BASE + UART_DR;
+}
+
+// Let the transmitter request DMA transfers
+void uart_dma_enable(bool enable) {
+    if (enable) {
+        UART_REG(UART_DMACR) |= DMACR_TXDMAE;
+    } else {
+        // Drain the FIFO before handing the transmitter back to the CPU
+        while (UART_REG(UART_FR) & FR_BUSY);
+        UART_REG(UART_DMACR) &= ~DMACR_TXDMAE;
+    }
+}
@@ -3,4 +3,11 @@
 void uart_init();
 void uart_putc(char c);
 char uart_getc();
+bool uart_rx_ready();
+void uart_rx_interrupt(bool enable);
+void uart_set_rx_wait(void (*wait)());
 void uart_puts(const char* str);
+void uart_capture_begin(char* buf, unsigned int size);
+unsigned int uart_capture_end();
+unsigned int uart_dma_address();
+void uart_dma_enable(bool enable);
@@ -1,14 +1,127 @@
+/*
+ * Boot entry, exception vectors and the IRQ entry path
+ * Everything runs in SVC mode. The IRQ and abort modes only have small
+ * stacks: an interrupt is moved onto the interrupted process's SVC stack
+ * so the handler can switch processes before returning.
+ */
+
+.syntax unified
+.arm
+
+@ Processor modes and mask bits
+.equ MODE_IRQ, 0x12
+.equ MODE_SVC, 0x13
+.equ MODE_ABT, 0x17
+.equ MODE_UND, 0x1B
+.equ I_BIT,    0x80
+.equ F_BIT,    0x40
+
+.text
+
 .global _start
 
 _start:
+    @ Stacks for the exception modes, then the kernel stack
+    msr cpsr_c, #(MODE_IRQ | I_BIT | F_BIT)
+    ldr sp, =irq_stack_top
+    msr cpsr_c, #(MODE_ABT | I_BIT | F_BIT)
+    ldr sp, =abort_stack_top
+    msr cpsr_c, #(MODE_UND | I_BIT | F_BIT)
+    ldr sp, =abort_stack_top
+    msr cpsr_c, #(MODE_SVC | I_BIT | F_BIT)
     ldr sp, =stack_top
     bl _start_cpp
 
 loop:
     b loop
 
+@ Exception vector table, copied to address 0 by vectors_install.
+@ The handler addresses are loaded PC-relative, so the copy works anywhere.
+.align 5
+vector_table:
+    ldr pc, vector_reset
+    ldr pc, vector_undef
+    ldr pc, vector_swi
+    ldr pc, vector_pabort
+    ldr pc, vector_dabort
+    nop                         @ Reserved
+    ldr pc, vector_irq
+    ldr pc, vector_fiq
+vector_reset:  .word _start
+vector_undef:  .word undef_entry
+vector_swi:    .word swi_entry
+vector_pabort: .word pabort_entry
+vector_dabort: .word dabort_entry
+vector_unused: .word 0
+vector_irq:    .word irq_entry
+vector_fiq:    .word fiq_entry
+vector_table_end:
+
+@ void vectors_install()
+.global vectors_install
+.type vectors_install, %function
+vectors_install:
+    ldr     r0, =vector_table
+    ldr     r1, =vector_table_end
+    mov     r2, #0
+1:  ldr     r3, [r0], #4
+    str     r3, [r2], #4
+    cmp     r0, r1
+    blo     1b
+    bx      lr
+.size vectors_install, . - vectors_install
+
+@ IRQ: build a frame of {cpsr, r0-r12, lr, pc} on the interrupted SVC stack,
+@ run irq_handle (which may switch processes) and return through the frame
+irq_entry:
+    sub     lr, lr, #4
+    stmdb   sp, {r0-r3}                 @ Scratch just below the IRQ stack top
+    sub     r0, sp, #16
+    mrs     r1, spsr
+    mov     r2, lr
+    msr     cpsr_c, #(MODE_SVC | I_BIT | F_BIT)
+    stmfd   sp!, {r2}                   @ Return address
+    stmfd   sp!, {r4-r12, lr}
+    ldmia   r0, {r3-r6}                 @ Interrupted r0-r3
+    stmfd   sp!, {r3-r6}
+    stmfd   sp!, {r1}                   @ Interrupted cpsr
+    mov     r4, sp                      @ Frame, preserved across the call
+    bic     sp, sp, #7                  @ Calls need an 8-byte aligned stack
+    bl      irq_handle
+    mov     sp, r4
+    ldmfd   sp!, {r1}
+    msr     spsr_cxsf, r1
+    ldmfd   sp!, {r0-r12, lr, pc}^      @ Also restores cpsr
+
+@ Faults report the faulting address and halt
+undef_entry:
+    mov     r0, #1
+    sub     r1, lr, #4
+    b       exception_fault
+pabort_entry:
+    mov     r0, #3
+    sub     r1, lr, #4
+    b       exception_fault
+dabort_entry:
+    mov     r0, #4
+    sub     r1, lr, #8
+    b       exception_fault
+
+@ SWIs are not used by the kernel; return to the caller
+swi_entry:
+    movs    pc, lr
+
+fiq_entry:
+    subs    pc, lr, #4
+
 .section .bss
 .align 4
 stack_bottom:
-.skip 4096 /* 4KB stack */
+.skip 8192 /* 8KB kernel stack */
 stack_top:
+irq_stack:
+.skip 64 /* Scratch for irq_entry */
+irq_stack_top:
+abort_stack:
+.skip 512 /* Shared by the abort and undefined modes */
+abort_stack_top: